@@ -1,586 +1,6545 @@
-#include <iostream>
-#include <vector>
-#include <string>
-#include <algorithm>
-#include <random>
-#include <ctime>
-#include <cctype>
-
-using namespace std;
-
-enum class Suit { Clubs, Diamonds, Hearts, Spades };
-
-enum class Rank {
-    Two = 2, Three, Four, Five, Six, Seven, Eight, Nine, Ten,
-    Jack = 10, Queen = 10, King = 10, Ace = 11
-};
-
-struct Card {
-    Suit suit;
-    Rank rank;
-};
-
-string suitToString(Suit s) {
-    switch (s) {
-        case Suit::Clubs:    return "C";
-        case Suit::Diamonds: return "D";
-        case Suit::Hearts:   return "H";
-        case Suit::Spades:   return "S";
-    }
-    return "?";
-}
-
-string rankToString(Rank r) {
-    int v = static_cast<int>(r);
-    if (v >= 2 && v <= 10) return to_string(v);
-    if (r == Rank::Jack)  return "J";
-    if (r == Rank::Queen) return "Q";
-    if (r == Rank::King)  return "K";
-    if (r == Rank::Ace)   return "A";
-    return "?";
-}
-
-string cardToString(const Card& c) {
-    return rankToString(c.rank) + suitToString(c.suit);
-}
-
-// ----------------------- Deck ----------------------------
-class Deck {
-private:
-    vector<Card> cards;
-    mt19937 rng;
-
-public:
-    Deck() {
-        rng.seed(static_cast<unsigned int>(time(nullptr)));
-        initialize();
-    }
-
-    void initialize() {
-        cards.clear();
-        for (int s = 0; s < 4; ++s) {
-            for (int r = 2; r <= 10; ++r) {
-                Card c;
-                c.suit = static_cast<Suit>(s);
-                c.rank = static_cast<Rank>(r);
-                cards.push_back(c);
-            }
-            Card j{ static_cast<Suit>(s), Rank::Jack };
-            Card q{ static_cast<Suit>(s), Rank::Queen };
-            Card k{ static_cast<Suit>(s), Rank::King };
-            Card a{ static_cast<Suit>(s), Rank::Ace };
-            cards.push_back(j);
-            cards.push_back(q);
-            cards.push_back(k);
-            cards.push_back(a);
-        }
-    }
-
-    void shuffle() {
-        std::shuffle(cards.begin(), cards.end(), rng);
-    }
-
-    Card deal() {
-        if (cards.empty()) {
-            initialize();
-            shuffle();
-        }
-        Card c = cards.back();
-        cards.pop_back();
-        return c;
-    }
-};
-
-// ----------------------- Hand ----------------------------
-class Hand {
-private:
-    vector<Card> cards;
-
-public:
-    void clear() { cards.clear(); }
-
-    void addCard(const Card& c) { cards.push_back(c); }
-
-    size_t size() const { return cards.size(); }
-
-    const vector<Card>& getCards() const { return cards; }
-
-    Card removeCard(size_t index) {
-        Card c = cards.at(index);
-        cards.erase(cards.begin() + static_cast<long>(index));
-        return c;
-    }
-
-    int getValue() const {
-        int total = 0;
-        int aceCount = 0;
-        for (const Card& c : cards) {
-            if (c.rank == Rank::Ace) {
-                total += 11;
-                aceCount++;
-            } else {
-                total += static_cast<int>(c.rank);
-            }
-        }
-        // Make some aces count as 1 if needed
-        while (total > 21 && aceCount > 0) {
-            total -= 10;
-            aceCount--;
-        }
-        return total;
-    }
-
-    bool containsAce() const {
-        for (const Card& c : cards) {
-            if (c.rank == Rank::Ace) return true;
-        }
-        return false;
-    }
-
-    bool isSoft() const {
-        int total = 0;
-        int aceCount = 0;
-        for (const Card& c : cards) {
-            if (c.rank == Rank::Ace) {
-                total += 11;
-                aceCount++;
-            } else {
-                total += static_cast<int>(c.rank);
-            }
-        }
-        return (aceCount > 0 && total <= 21);
-    }
-
-    bool isBust() const { return getValue() > 21; }
-
-    bool isBlackjack() const { return cards.size() == 2 && getValue() == 21; }
-
-    void show(bool hideFirstCard = false) const {
-        for (size_t i = 0; i < cards.size(); ++i) {
-            if (i == 0 && hideFirstCard) {
-                cout << "?? ";
-            } else {
-                cout << cardToString(cards[i]) << " ";
-            }
-        }
-        if (!hideFirstCard) {
-            cout << "(" << getValue() << ")";
-        }
-        cout << endl;
-    }
-};
-
-// -------------------- UI helpers ------------------------
-void showWelcome() {
-    cout << "=====================================\n";
-    cout << "           CASINO BLACKJACK          \n";
-    cout << "=====================================\n";
-    cout << "Rules (program version):\n";
-    cout << " - Single player vs. dealer.\n";
-    cout << " - Dealer hits on 16 or less, stands on 17+.\n";
-    cout << " - Doubling down and splitting pairs allowed.\n";
-    cout << " - Blackjack (Ace + 10-value) pays 3:2.\n";
-    cout << "=====================================\n\n";
-}
-
-double getBet(double bankroll) {
-    double bet;
-    while (true) {
-        cout << "You have $" << bankroll << ". Enter your bet: ";
-        cin >> bet;
-        if (!cin) {
-            cin.clear();
-            cin.ignore(1000, '\n');
-            cout << "Invalid input. Try again.\n";
-            continue;
-        }
-        if (bet <= 0) {
-            cout << "Bet must be positive.\n";
-        } else if (bet > bankroll) {
-            cout << "You cannot bet more than your bankroll.\n";
-        } else {
-            break;
-        }
-    }
-    return bet;
-}
-
-// ---------------- Basic strategy engine -----------------
-enum class BasicAction { Hit, Stand, DoubleDown, Split };
-
-string actionToString(BasicAction a) {
-    switch (a) {
-        case BasicAction::Hit:        return "HIT";
-        case BasicAction::Stand:      return "STAND";
-        case BasicAction::DoubleDown: return "DOUBLE DOWN";
-        case BasicAction::Split:      return "SPLIT";
-    }
-    return "";
-}
-
-int cardValueForStrategy(const Card& c) {
-    if (c.rank == Rank::Ace) return 11;
-    return static_cast<int>(c.rank);
-}
-
-bool isPair(const Hand& h) {
-    if (h.size() != 2) return false;
-    const auto& cards = h.getCards();
-    return cardValueForStrategy(cards[0]) == cardValueForStrategy(cards[1]);
-}
-
-int dealerUpValue(const Hand& dealer) {
-    const auto& cards = dealer.getCards();
-    if (cards.empty()) return 0;
-    // Second card is face up in our display
-    int v = cardValueForStrategy(cards[1]);
-    if (v > 10) v = 10; // treat J/Q/K as 10
-    return v;
-}
-
-// Implements the rules from your handout (soft hand, doubling, splitting)
-BasicAction basicStrategySuggestion(const Hand& hand,
-                                    int dealerUp,
-                                    bool canDouble,
-                                    bool canSplit) {
-    int total = hand.getValue();
-    bool soft = hand.isSoft();
-
-    // --- Splitting rules ---
-    if (canSplit && isPair(hand)) {
-        const auto& cards = hand.getCards();
-        int pairVal = cardValueForStrategy(cards[0]);
-
-        // Never split 10s, 5s or 4s
-        if (pairVal == 10 || pairVal == 5 || pairVal == 4) {
-            // fall through to normal strategy
-        } else if (pairVal == 8 || pairVal == 11) {
-            // always split 8s and Aces
-            return BasicAction::Split;
-        } else {
-            // other pairs: split vs dealer 2–7
-            if (dealerUp >= 2 && dealerUp <= 7) {
-                return BasicAction::Split;
-            }
-        }
-    }
-
-    // --- Soft hands ---
-    if (soft) {
-        if (total <= 17) {
-            // always hit soft 17 or less
-            return BasicAction::Hit;
-        } else if (total == 18) {
-            // hit soft 18 vs dealer 9 or 10 (incl. J/Q/K) or Ace
-            if (dealerUp == 9 || dealerUp == 10 || dealerUp == 11) {
-                return BasicAction::Hit;
-            } else {
-                return BasicAction::Stand;
-            }
-        } else {
-            // soft 19+ stand
-            return BasicAction::Stand;
-        }
-    }
-
-    // --- Hard hands + doubling rules ---
-    if (canDouble) {
-        if (total == 11) {
-            // always double 11
-            return BasicAction::DoubleDown;
-        }
-        if (total == 10) {
-            // double 10 unless dealer 10 or Ace
-            if (dealerUp != 10 && dealerUp != 11) {
-                return BasicAction::DoubleDown;
-            }
-        }
-        if (total == 9) {
-            // double 9 vs dealer 2–6
-            if (dealerUp >= 2 && dealerUp <= 6) {
-                return BasicAction::DoubleDown;
-            }
-        }
-    }
-
-    // --- Hard totals: hit/stand ---
-    if (total <= 8) return BasicAction::Hit;
-
-    if (total == 9) {
-        return BasicAction::Hit;
-    }
-
-    if (total >= 10 && total <= 11) {
-        return BasicAction::Hit;
-    }
-
-    if (total >= 12 && total <= 16) {
-        // stand vs 2–6, otherwise hit
-        if (dealerUp >= 2 && dealerUp <= 6) return BasicAction::Stand;
-        return BasicAction::Hit;
-    }
-
-    // 17 or more – stand
-    return BasicAction::Stand;
-}
-
-// Ask the player for action, checking which moves are legal
-char getPlayerChoice(bool canHit, bool canStand,
-                     bool canDouble, bool canSplit) {
-    while (true) {
-        cout << "Choose action: ";
-        cout << "(H)it";
-        if (canStand)  cout << ", (S)tand";
-        if (canDouble) cout << ", (D)ouble";
-        if (canSplit)  cout << ", S(P)lit";
-        cout << ": ";
-
-        char ch;
-        cin >> ch;
-        ch = static_cast<char>(toupper(static_cast<unsigned char>(ch)));
-
-        if (ch == 'H' && canHit)    return ch;
-        if (ch == 'S' && canStand)  return ch;
-        if (ch == 'D' && canDouble) return ch;
-        if (ch == 'P' && canSplit)  return ch;
-
-        cout << "Invalid choice, try again.\n";
-    }
-}
-
-// ------------------------- main -------------------------
-int main() {
-    Deck deck;
-    deck.shuffle();
-
-    double bankroll = 100.0;
-    char playAgain = 'Y';
-    showWelcome();
-
-    while (playAgain == 'Y' && bankroll > 0.0) {
-        cout << "\n===== NEW ROUND =====\n";
-        double baseBet = getBet(bankroll);
-
-        // subtract initial bet from bankroll
-        bankroll -= baseBet;
-
-        Hand dealer;
-        vector<Hand>  playerHands(1);
-        vector<double> bets(1, baseBet);
-        vector<bool>   handFinished(1, false);
-        vector<bool>   fromSplitAces(1, false);
-
-        // Initial deal: player and dealer
-        playerHands[0].addCard(deck.deal());
-        dealer.addCard(deck.deal());
-        playerHands[0].addCard(deck.deal());
-        dealer.addCard(deck.deal());
-
-        cout << "Dealer's hand: ";
-        dealer.show(true);
-        cout << "Your hand: ";
-        playerHands[0].show(false);
-
-        int dUpVal = dealerUpValue(dealer);
-        BasicAction sugg =
-            basicStrategySuggestion(playerHands[0], dUpVal,
-                /*canDouble*/ bankroll >= bets[0] && playerHands[0].size() == 2,
-                /*canSplit*/  bankroll >= bets[0] && playerHands.size() == 1
-                               && isPair(playerHands[0]));
-        cout << "[Basic Strategy Suggestion] "
-             << actionToString(sugg) << "\n";
-
-        bool playerBlackjack      = playerHands[0].isBlackjack();
-        bool dealerBlackjackFlag  = dealer.isBlackjack();
-
-        // ----------- Natural blackjack check --------------
-        if (playerBlackjack || dealerBlackjackFlag) {
-            cout << "\n--- Checking for Blackjack ---\n";
-            cout << "Dealer's full hand: ";
-            dealer.show(false);
-
-            if (playerBlackjack && dealerBlackjackFlag) {
-                cout << "Both you and the dealer have Blackjack. Push.\n";
-                // return original bet
-                bankroll += baseBet;
-            } else if (playerBlackjack) {
-                cout << "You have Blackjack! You win 1.5x your bet.\n";
-                bankroll += baseBet * 2.5;  // stake + 1.5× winnings
-            } else {
-                cout << "Dealer has Blackjack. You lose.\n";
-                // bet already removed
-            }
-        } else {
-            // ------------- Player actions (supports split) -------------
-            for (size_t h = 0; h < playerHands.size(); ++h) {
-                while (!handFinished[h] && !playerHands[h].isBust()) {
-                    cout << "\n--- Playing Hand " << (h + 1) << " ---\n";
-                    cout << "Dealer shows: ";
-                    dealer.show(true);
-                    cout << "Your hand: ";
-                    playerHands[h].show(false);
-
-                    bool canHit    = true;
-                    bool canStand  = true;
-                    bool canDouble = (playerHands[h].size() == 2 &&
-                                      bankroll >= bets[h] &&
-                                      !fromSplitAces[h]);
-                    // Only allow one split total (playerHands.size()==1)
-                    bool canSplit  = (playerHands.size() == 1 &&
-                                      playerHands[h].size() == 2 &&
-                                      isPair(playerHands[h]) &&
-                                      bankroll >= bets[h]);
-
-                    int dUp = dealerUpValue(dealer);
-                    BasicAction suggestion =
-                        basicStrategySuggestion(playerHands[h], dUp,
-                                                canDouble, canSplit);
-                    cout << "[Basic Strategy Suggestion] "
-                         << actionToString(suggestion) << "\n";
-
-                    char choice =
-                        getPlayerChoice(canHit, canStand,
-                                        canDouble, canSplit);
-
-                    if (choice == 'H') {
-                        Card c = deck.deal();
-                        cout << "You draw: " << cardToString(c) << "\n";
-                        playerHands[h].addCard(c);
-                        cout << "Your hand: ";
-                        playerHands[h].show(false);
-                        if (playerHands[h].isBust()) {
-                            cout << "You bust on this hand.\n";
-                            handFinished[h] = true;
-                        }
-                    } else if (choice == 'S') {
-                        handFinished[h] = true;
-                    } else if (choice == 'D' && canDouble) {
-                        // Double bet, one more card only
-                        bankroll -= bets[h];
-                        bets[h] *= 2;
-                        Card c = deck.deal();
-                        cout << "You double down and draw: "
-                             << cardToString(c) << "\n";
-                        playerHands[h].addCard(c);
-                        cout << "Your hand: ";
-                        playerHands[h].show(false);
-                        if (playerHands[h].isBust()) {
-                            cout << "You bust on this hand.\n";
-                        }
-                        handFinished[h] = true;
-                    } else if (choice == 'P' && canSplit) {
-                        cout << "You choose to split the pair.\n";
-
-                        // Pay additional bet for new hand
-                        bankroll -= bets[h];
-
-                        // Create new hand from second card
-                        Hand newHand;
-                        Card moved = playerHands[h].removeCard(1);
-                        newHand.addCard(moved);
-
-                        // Deal one extra card to each split hand
-                        playerHands[h].addCard(deck.deal());
-                        newHand.addCard(deck.deal());
-
-                        double newBet = bets[h];
-                        bool splitAces = (cardValueForStrategy(moved) == 11);
-
-                        // Insert new hand right after current
-                        playerHands.insert(playerHands.begin()
-                                           + static_cast<long>(h + 1), newHand);
-                        bets.insert(bets.begin()
-                                    + static_cast<long>(h + 1), newBet);
-                        handFinished.insert(handFinished.begin()
-                                    + static_cast<long>(h + 1), false);
-                        fromSplitAces.insert(fromSplitAces.begin()
-                                    + static_cast<long>(h + 1), splitAces);
-
-                        fromSplitAces[h] = splitAces;
-
-                        cout << "Hand 1 after split: ";
-                        playerHands[h].show(false);
-                        cout << "Hand 2 after split: ";
-                        playerHands[h + 1].show(false);
-
-                        if (splitAces) {
-                            // Split aces: only one card per hand, no hits
-                            handFinished[h]     = true;
-                            handFinished[h + 1] = true;
-                            cout << "Split aces: each hand gets "
-                                    "one card only, no further hits.\n";
-                        }
-                    }
-                }
-            }
-
-            // ------------- Dealer plays (only if some hand alive) -------------
-            bool allBust = true;
-            for (const auto& h : playerHands) {
-                if (!h.isBust()) { allBust = false; break; }
-            }
-
-            if (allBust) {
-                cout << "\nAll your hands busted. Dealer wins automatically.\n";
-            } else {
-                cout << "\nDealer's turn...\n";
-                cout << "Dealer's hand: ";
-                dealer.show(false);
-
-                while (dealer.getValue() < 17) {
-                    Card c = deck.deal();
-                    cout << "Dealer draws: " << cardToString(c) << "\n";
-                    dealer.addCard(c);
-                    cout << "Dealer's hand: ";
-                    dealer.show(false);
-                }
-
-                int dealerTotal = dealer.getValue();
-                bool dealerBust = dealer.isBust();
-
-                // --------- Resolve each hand separately -------------
-                for (size_t h = 0; h < playerHands.size(); ++h) {
-                    cout << "\n--- Result for Hand " << (h + 1) << " ---\n";
-                    cout << "Your hand: ";
-                    playerHands[h].show(false);
-                    cout << "Dealer: ";
-                    dealer.show(false);
-
-                    if (playerHands[h].isBust()) {
-                        cout << "You busted. You lose this bet of $"
-                             << bets[h] << ".\n";
-                    } else if (dealerBust) {
-                        cout << "Dealer busts. You win!\n";
-                        bankroll += bets[h] * 2; // stake + win
-                    } else {
-                        int pTotal = playerHands[h].getValue();
-                        if (pTotal > dealerTotal) {
-                            cout << "You beat the dealer!\n";
-                            bankroll += bets[h] * 2;
-                        } else if (pTotal < dealerTotal) {
-                            cout << "Dealer wins this hand.\n";
-                        } else {
-                            cout << "Push on this hand. "
-                                    "Your bet is returned.\n";
-                            bankroll += bets[h];
-                        }
-                    }
-                }
-            }
-        }
-
-        cout << "Your bankroll: $" << bankroll << "\n";
-        if (bankroll <= 0.0) {
-            cout << "You are out of money. Game over.\n";
-            break;
-        }
-
-        cout << "Play another round? (Y/N): ";
-        cin >> playAgain;
-        playAgain =
-            static_cast<char>(toupper(static_cast<unsigned char>(playAgain)));
-    }
-
-    cout << "Thanks for playing Casino Blackjack!\n";
-    return 0;
-}
+#include <iostream>
+#include <vector>
+#include <array>
+#include <string>
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <ctime>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <cstdlib>
+#include <cstdint>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <unordered_map>
+
+#include <arpa/inet.h>
+#include <csignal>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define BLACKJACK_AVX2_KERNEL 1
+#endif
+
+using namespace std;
+
+enum class Suit : uint8_t { Clubs, Diamonds, Hearts, Spades };
+
+enum class Rank : uint8_t {
+    Two = 2, Three, Four, Five, Six, Seven, Eight, Nine, Ten,
+    Jack = 10, Queen = 10, King = 10, Ace = 11
+};
+
+struct Card {
+    Suit suit;
+    Rank rank;
+};
+
+string suitToString(Suit s) {
+    switch (s) {
+        case Suit::Clubs:    return "C";
+        case Suit::Diamonds: return "D";
+        case Suit::Hearts:   return "H";
+        case Suit::Spades:   return "S";
+    }
+    return "?";
+}
+
+string rankToString(Rank r) {
+    int v = static_cast<int>(r);
+    if (v >= 2 && v <= 10) return to_string(v);
+    if (r == Rank::Jack)  return "J";
+    if (r == Rank::Queen) return "Q";
+    if (r == Rank::King)  return "K";
+    if (r == Rank::Ace)   return "A";
+    return "?";
+}
+
+string cardToString(const Card& c) {
+    return rankToString(c.rank) + suitToString(c.suit);
+}
+
+// ----------------------- Seeds ---------------------------
+// SplitMix64 step; used to spread one master seed over many streams.
+uint64_t splitmix64(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Seed for stream `stream` of a run started from `master`. Different
+// streams get unrelated seeds, the same pair always gets the same one.
+uint64_t streamSeed(uint64_t master, uint64_t stream) {
+    uint64_t state = master ^ (stream * 0xD1B54A32D192ED03ULL);
+    splitmix64(state);
+    return splitmix64(state);
+}
+
+// Non-reproducible seed for interactive play
+uint64_t freshSeed() {
+    random_device rd;
+    uint64_t state = (static_cast<uint64_t>(rd()) << 32) ^ rd()
+                   ^ static_cast<uint64_t>(time(nullptr));
+    return splitmix64(state);
+}
+
+// ----------------------- RNGs ----------------------------
+// Card shuffling only needs 32-bit draws. Every generator offers
+// next32(), construction from a 64-bit seed, and forStream(), which
+// gives worker `stream` of a run its own generator.
+
+// std::mt19937, the program's original generator
+class Mt19937Rng {
+private:
+    mt19937 engine;
+
+public:
+    static constexpr const char* name = "mt19937";
+
+    explicit Mt19937Rng(uint64_t seed) {
+        // Feed all 64 seed bits through seed_seq to fill the full state
+        seed_seq seq{ static_cast<uint32_t>(seed),
+                      static_cast<uint32_t>(seed >> 32) };
+        engine.seed(seq);
+    }
+
+    static Mt19937Rng forStream(uint64_t master, uint64_t stream) {
+        return Mt19937Rng(streamSeed(master, stream));
+    }
+
+    uint32_t next32() { return static_cast<uint32_t>(engine()); }
+};
+
+// xoshiro256** (Blackman & Vigna). Streams are 2^128 draws apart via
+// jump(), so they can never overlap.
+class Xoshiro256ss {
+private:
+    array<uint64_t, 4> s;
+
+    static uint64_t rotl(uint64_t x, int k) {
+        return (x << k) | (x >> (64 - k));
+    }
+
+public:
+    static constexpr const char* name = "xoshiro256**";
+
+    explicit Xoshiro256ss(uint64_t seed) {
+        for (uint64_t& word : s) word = splitmix64(seed);
+    }
+
+    static Xoshiro256ss forStream(uint64_t master, uint64_t stream) {
+        Xoshiro256ss rng(master);
+        for (uint64_t i = 0; i < stream; ++i) rng.jump();
+        return rng;
+    }
+
+    uint64_t next64() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    uint32_t next32() { return static_cast<uint32_t>(next64() >> 32); }
+
+    // Equivalent to 2^128 calls to next64()
+    void jump() {
+        static constexpr uint64_t kJump[] = {
+            0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL,
+            0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL
+        };
+        array<uint64_t, 4> acc{};
+        for (uint64_t word : kJump) {
+            for (int b = 0; b < 64; ++b) {
+                if (word & (1ULL << b)) {
+                    for (int i = 0; i < 4; ++i) acc[i] ^= s[i];
+                }
+                next64();
+            }
+        }
+        s = acc;
+    }
+};
+
+// PCG64 (XSL RR 128/64, O'Neill). Each stream uses its own increment.
+class Pcg64 {
+private:
+    using u128 = unsigned __int128;
+    u128 state = 0;
+    u128 inc = 1;
+
+    static constexpr u128 kMultiplier =
+        (static_cast<u128>(2549297995355413924ULL) << 64) |
+        4865540595714422341ULL;
+
+public:
+    static constexpr const char* name = "pcg64";
+
+    Pcg64(uint64_t seed, uint64_t stream) {
+        inc = (static_cast<u128>(stream) << 1) | 1u;
+        state = 0;
+        next64();
+        uint64_t mix = seed;
+        state += (static_cast<u128>(splitmix64(mix)) << 64) | seed;
+        next64();
+    }
+
+    explicit Pcg64(uint64_t seed) : Pcg64(seed, 0) {}
+
+    static Pcg64 forStream(uint64_t master, uint64_t stream) {
+        return Pcg64(master, stream);
+    }
+
+    uint64_t next64() {
+        state = state * kMultiplier + inc;
+        uint64_t value = static_cast<uint64_t>(state >> 64) ^
+                         static_cast<uint64_t>(state);
+        int rot = static_cast<int>(state >> 122);
+        return (value >> rot) | (value << ((-rot) & 63));
+    }
+
+    uint32_t next32() { return static_cast<uint32_t>(next64() >> 32); }
+};
+
+// Uniform integer in [0, range) by Lemire's nearly divisionless method:
+// one multiply per draw, and a division only on the rare rejection path.
+template <class Rng>
+uint32_t boundedRand(Rng& rng, uint32_t range) {
+    uint64_t m = static_cast<uint64_t>(rng.next32()) * range;
+    uint32_t low = static_cast<uint32_t>(m);
+    if (low < range) {
+        uint32_t threshold = static_cast<uint32_t>(-range) % range;
+        while (low < threshold) {
+            m = static_cast<uint64_t>(rng.next32()) * range;
+            low = static_cast<uint32_t>(m);
+        }
+    }
+    return static_cast<uint32_t>(m >> 32);
+}
+
+// Fisher–Yates shuffle of [first, last)
+template <class It, class Rng>
+void fisherYates(It first, It last, Rng& rng) {
+    auto n = last - first;
+    for (auto i = n - 1; i > 0; --i) {
+        auto j = boundedRand(rng, static_cast<uint32_t>(i + 1));
+        swap(first[i], first[j]);
+    }
+}
+
+// Which generator a simulation shuffles with (--rng)
+enum class RngKind { Mt19937, Xoshiro, Pcg };
+
+// ------------------- Count systems ----------------------
+// A count system tags each card value with a small integer; the running
+// count is the sum of the tags of every card seen since the shuffle.
+// Unbalanced systems (KO) start from an initial running count so that
+// their key count does not depend on the number of decks.
+struct CountSystem {
+    const char* name;
+    int8_t tags[12];   // indexed by Rank value: 2-10, ace at 11
+    int    imbalance;  // sum of the tags over one 52-card deck
+    int    level;      // largest tag, used to scale true counts
+    int    initialPerDeck;  // IRC = initialPerDeck * (decks - 1)
+};
+
+constexpr CountSystem kHiLo    = { "Hi-Lo",
+    { 0, 0, 1, 1, 1, 1, 1, 0, 0, 0, -1, -1 }, 0, 1, 0 };
+constexpr CountSystem kKO      = { "KO",
+    { 0, 0, 1, 1, 1, 1, 1, 1, 0, 0, -1, -1 }, 4, 1, -4 };
+constexpr CountSystem kOmegaII = { "Omega II",
+    { 0, 0, 1, 1, 2, 2, 2, 1, 0, -1, -2, 0 }, 0, 2, 0 };
+
+const CountSystem* findCountSystem(const string& name) {
+    if (name == "hilo")   return &kHiLo;
+    if (name == "ko")     return &kKO;
+    if (name == "omega2") return &kOmegaII;
+    return nullptr;
+}
+
+// --------------------- Telemetry ------------------------
+// Built with -DBLACKJACK_TELEMETRY, the hot paths count events and time
+// the phases of a round in TSC ticks, each thread into its own block. A
+// reporter thread reads every block while a simulation runs. Without the
+// flag, BLACKJACK_PHASE and BLACKJACK_COUNT expand to nothing and the
+// round engine compiles exactly as before. Phases never nest, so their
+// shares add up to the time measured. Shuffle is the between-round
+// shuffle only. A reshuffle forced mid-round counts in Reshuffles, and
+// its time stays with the deal, decision or dealer phase it interrupts.
+enum class Phase : uint8_t { Shuffle, Deal, Decision, Dealer, Settle };
+constexpr int kPhases = 5;
+constexpr const char* kPhaseNames[kPhases] = {
+    "shuffle", "deal", "decision", "dealer", "settle"
+};
+
+enum class Counter : uint8_t {
+    Rounds, Splits, Doubles, Reshuffles, PlayerBusts, DealerBusts
+};
+constexpr int kCounters = 6;
+constexpr const char* kCounterNames[kCounters] = {
+    "rounds", "splits", "doubles", "reshuffles", "player_busts",
+    "dealer_busts"
+};
+
+#ifdef BLACKJACK_TELEMETRY
+inline uint64_t readTicks() {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    return __builtin_ia32_rdtsc();
+#else
+    return static_cast<uint64_t>(
+        chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+// Phase times go into power-of-two buckets: bucket b holds times of
+// fewer than 2^b ticks (and at least 2^(b-1)).
+constexpr int kTickBuckets = 40;
+
+// Every call of a phase is counted but only one in kTimeEvery is timed:
+// a TSC read costs 20-30 ns under virtualization, as much as a phase.
+constexpr uint32_t kTimeEvery = 16;
+
+int tickBucket(uint64_t ticks) {
+    int b = ticks ? 64 - __builtin_clzll(ticks) : 0;
+    return min(b, kTickBuckets - 1);
+}
+
+// Written by its own thread only, so an update is a relaxed load and
+// store rather than a locked add; the reporter may read a value one
+// event stale.
+struct TelemetryBlock {
+    atomic<uint64_t> counters[kCounters]{};
+    atomic<uint64_t> calls[kPhases]{};
+    atomic<uint64_t> timed[kPhases]{};
+    atomic<uint64_t> ticks[kPhases]{};
+    atomic<uint64_t> histogram[kPhases][kTickBuckets]{};
+
+    static void bump(atomic<uint64_t>& a, uint64_t by = 1) {
+        a.store(a.load(memory_order_relaxed) + by, memory_order_relaxed);
+    }
+
+    void count(Counter c) { bump(counters[static_cast<int>(c)]); }
+
+    // Counts a call of phase p; true when this one should be timed
+    bool enter(Phase p) {
+        int i = static_cast<int>(p);
+        uint64_t n = calls[i].load(memory_order_relaxed);
+        calls[i].store(n + 1, memory_order_relaxed);
+        return n % kTimeEvery == 0;
+    }
+
+    void time(Phase p, uint64_t t) {
+        int i = static_cast<int>(p);
+        bump(timed[i]);
+        bump(ticks[i], t);
+        bump(histogram[i][tickBucket(t)]);
+    }
+};
+
+// Sum of every thread's block at one moment
+struct TelemetrySnapshot {
+    chrono::steady_clock::time_point at;
+    uint64_t counters[kCounters] = {};
+    uint64_t calls[kPhases] = {};
+    uint64_t timed[kPhases] = {};
+    uint64_t ticks[kPhases] = {};
+    uint64_t histogram[kPhases][kTickBuckets] = {};
+
+    TelemetrySnapshot since(const TelemetrySnapshot& before) const {
+        TelemetrySnapshot d = *this;
+        for (int c = 0; c < kCounters; ++c) d.counters[c] -= before.counters[c];
+        for (int p = 0; p < kPhases; ++p) {
+            d.calls[p] -= before.calls[p];
+            d.timed[p] -= before.timed[p];
+            d.ticks[p] -= before.ticks[p];
+            for (int b = 0; b < kTickBuckets; ++b) {
+                d.histogram[p][b] -= before.histogram[p][b];
+            }
+        }
+        return d;
+    }
+
+    // Mean ticks per call of phase p, from the timed calls
+    double meanTicks(int p) const {
+        return timed[p] ? static_cast<double>(ticks[p]) /
+                              static_cast<double>(timed[p])
+                        : 0.0;
+    }
+
+    // Upper bound of the bucket holding quantile q of phase p, in ticks
+    uint64_t quantileTicks(int p, double q) const {
+        uint64_t target = static_cast<uint64_t>(
+            ceil(q * static_cast<double>(timed[p])));
+        uint64_t seen = 0;
+        for (int b = 0; b < kTickBuckets; ++b) {
+            seen += histogram[p][b];
+            if (seen >= target && seen > 0) return uint64_t{1} << b;
+        }
+        return 0;
+    }
+};
+
+// Blocks are never freed, so a finished worker's counts stay in the
+// totals and the reporter never reads a dead thread's memory.
+class Telemetry {
+private:
+    mutex lock;
+    vector<unique_ptr<TelemetryBlock>> blocks;
+
+public:
+    static Telemetry& instance() {
+        static Telemetry t;
+        return t;
+    }
+
+    TelemetryBlock& threadBlock() {
+        thread_local TelemetryBlock* block = nullptr;
+        if (!block) {
+            lock_guard<mutex> guard(lock);
+            blocks.push_back(make_unique<TelemetryBlock>());
+            block = blocks.back().get();
+        }
+        return *block;
+    }
+
+    TelemetrySnapshot snapshot() {
+        TelemetrySnapshot s;
+        s.at = chrono::steady_clock::now();
+        lock_guard<mutex> guard(lock);
+        for (const auto& b : blocks) {
+            const auto load = [](const atomic<uint64_t>& a) {
+                return a.load(memory_order_relaxed);
+            };
+            for (int c = 0; c < kCounters; ++c) {
+                s.counters[c] += load(b->counters[c]);
+            }
+            for (int p = 0; p < kPhases; ++p) {
+                s.calls[p] += load(b->calls[p]);
+                s.timed[p] += load(b->timed[p]);
+                s.ticks[p] += load(b->ticks[p]);
+                for (int k = 0; k < kTickBuckets; ++k) {
+                    s.histogram[p][k] += load(b->histogram[p][k]);
+                }
+            }
+        }
+        return s;
+    }
+};
+
+class PhaseTimer {
+private:
+    TelemetryBlock& block;
+    Phase phase;
+    uint64_t start = 0;  // 0 when this call is not timed
+
+public:
+    explicit PhaseTimer(Phase p)
+        : block(Telemetry::instance().threadBlock()), phase(p) {
+        if (block.enter(p)) start = readTicks();
+    }
+    ~PhaseTimer() {
+        if (start) block.time(phase, readTicks() - start);
+    }
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+};
+
+#define BLACKJACK_CONCAT_(a, b) a##b
+#define BLACKJACK_CONCAT(a, b) BLACKJACK_CONCAT_(a, b)
+// Times the rest of the enclosing scope as phase `p`
+#define BLACKJACK_PHASE(p) \
+    PhaseTimer BLACKJACK_CONCAT(blackjackPhase, __LINE__)(Phase::p)
+#define BLACKJACK_COUNT(c) \
+    Telemetry::instance().threadBlock().count(Counter::c)
+#else
+#define BLACKJACK_PHASE(p) ((void)0)
+#define BLACKJACK_COUNT(c) ((void)0)
+#endif
+
+// ----------------------- Shoe ----------------------------
+// Checkpoint bytes: trivially copyable values appended raw, in host byte
+// order, since a checkpoint is resumed by the same build that wrote it.
+template <class T>
+void putBytes(string& out, const T& v) {
+    static_assert(is_trivially_copyable<T>::value, "raw bytes only");
+    out.append(reinterpret_cast<const char*>(&v), sizeof v);
+}
+
+template <class T>
+bool getBytes(const char*& p, const char* end, T& v) {
+    static_assert(is_trivially_copyable<T>::value, "raw bytes only");
+    if (static_cast<size_t>(end - p) < sizeof v) return false;
+    memcpy(&v, p, sizeof v);
+    p += sizeof v;
+    return true;
+}
+
+// One to eight 52-card decks in a card array that is built once and
+// reordered in place. Dealing only advances an index. The cut card sits
+// at `penetration` of the shoe; once it is out, prepareRound() shuffles
+// before the next round, so a reshuffle never splits a hand.
+//
+// The generator is a template parameter of BasicShoe below. Shoe itself
+// only reaches it through shuffleCards(), once per shuffle, so the round
+// engine deals from any shoe without being instantiated per generator.
+//
+// The shoe also keeps the running count for an optional count system:
+// one table lookup and add per card dealt. The dealer's hole card comes
+// from dealHidden() and is only counted once revealHidden() turns it up.
+//
+// useContinuousShuffler() turns the shoe into a continuous shuffling
+// machine (CSM). The array is then [cards dealt this round | tray |
+// machine]: cards are dealt from a tray of a few cards, and every card
+// dealt pulls a random card from the machine into the tray, one swap.
+// Between rounds the discards join the machine. Since the tray always
+// takes a random machine card, a discard lands in effect at a random
+// place in the machine, at O(1) per card and with no reshuffle pass. A
+// discard can come out again once the tray has been dealt past. Pulls
+// fill the array in order, so the cards at each position depend only on
+// the generator, not on when they were pulled.
+class Shoe {
+private:
+    vector<Card> cards;
+    size_t next = 0;        // next card to deal
+    size_t roundStart = 0;  // first card dealt this round
+    size_t cutCard = 0;
+    size_t trayEnd = 0;     // CSM only: the machine starts here
+    size_t trayCards = 0;   // CSM only: cards kept waiting in the tray
+    bool   continuous = false;
+    int    decks = 1;
+
+    const CountSystem* system = nullptr;
+    int8_t tags[12] = {};   // all zero while no system is attached
+    int    running = 0;
+    int    hiddenTag = 0;   // tag of the hole card until it is revealed
+
+    int initialCount() const {
+        return system ? system->initialPerDeck * (decks - 1) : 0;
+    }
+
+    // Every card is on the table. roundCanEmptyShoe() keeps the table
+    // small enough for this never to happen, so it is a bug, not a deal.
+    [[noreturn]] void ranDry() const {
+        cerr << "shoe ran dry: all " << cards.size()
+             << " cards are in play in one round\n";
+        abort();
+    }
+
+    // The shoe ran dry mid-round: move the cards in play to the front
+    // and shuffle the discards behind them, as a dealer would.
+    void reshuffleDiscards() {
+        BLACKJACK_COUNT(Reshuffles);  // timed by the phase it interrupts
+        size_t inPlay = next - roundStart;
+        if (inPlay == cards.size()) ranDry();
+        rotate(cards.begin(), cards.begin() + static_cast<long>(roundStart),
+               cards.begin() + static_cast<long>(next));
+        shuffleCards(cards.data() + inPlay, cards.size() - inPlay);
+        next = inPlay;
+        roundStart = 0;
+
+        // Only the cards on the table have been seen in the new shoe
+        running = initialCount() - hiddenTag;
+        for (size_t i = 0; i < inPlay; ++i) {
+            running += tags[static_cast<int>(cards[i].rank)];
+        }
+    }
+
+    // CSM: move a random machine card to the back of the tray
+    void pullIntoTray() {
+        size_t j = trayEnd + randomBelow(
+                                 static_cast<uint32_t>(cards.size() - trayEnd));
+        swap(cards[trayEnd], cards[j]);
+        ++trayEnd;
+    }
+
+    // CSM, between rounds: the tray moves to the front and the round's
+    // cards, now behind it, join the machine. Every card is back in play,
+    // so the count starts over.
+    void returnDiscards() {
+        rotate(cards.begin(), cards.begin() + static_cast<long>(next),
+               cards.begin() + static_cast<long>(trayEnd));
+        trayEnd -= next;
+        next = roundStart = 0;
+        running = initialCount();
+        hiddenTag = 0;
+    }
+
+protected:
+    virtual void shuffleCards(Card* first, size_t count) = 0;
+    virtual uint32_t randomBelow(uint32_t range) = 0;
+    virtual void copyGenerator(const Shoe& other) = 0;
+    virtual void saveGenerator(string& out) const = 0;
+    virtual bool loadGenerator(const char*& p, const char* end) = 0;
+
+    // randomBelow(range) picks among the last `range` cards of this
+    const vector<Card>& cardArray() const { return cards; }
+
+public:
+    static constexpr int kMaxDecks = 8;
+
+    // Whether one round of `playerHands` hands could deal every card. A
+    // deck holds 340 points counting aces as one; a player's hand stops
+    // by hard 31 (a ten on 21) and the dealer's by hard 26.
+    static bool roundCanEmptyShoe(int numDecks, int playerHands) {
+        return playerHands * 31 + 26 >= numDecks * 340;
+    }
+
+    Shoe(int numDecks, double penetration) {
+        decks = min(max(numDecks, 1), kMaxDecks);
+        penetration = min(max(penetration, 0.1), 1.0);
+
+        cards.reserve(static_cast<size_t>(decks) * 52);
+        for (int d = 0; d < decks; ++d) {
+            for (int s = 0; s < 4; ++s) {
+                for (int r = 2; r <= 10; ++r) {
+                    cards.push_back({ static_cast<Suit>(s),
+                                      static_cast<Rank>(r) });
+                }
+                cards.push_back({ static_cast<Suit>(s), Rank::Jack });
+                cards.push_back({ static_cast<Suit>(s), Rank::Queen });
+                cards.push_back({ static_cast<Suit>(s), Rank::King });
+                cards.push_back({ static_cast<Suit>(s), Rank::Ace });
+            }
+        }
+        cutCard = static_cast<size_t>(penetration *
+                                      static_cast<double>(cards.size()));
+        // Start "used up" so the first round shuffles
+        next = roundStart = cards.size();
+    }
+
+    virtual ~Shoe() = default;
+
+    void shuffle() {
+        BLACKJACK_PHASE(Shuffle);
+        BLACKJACK_COUNT(Reshuffles);
+        shuffleCards(cards.data(), cards.size());
+        next = roundStart = 0;
+        running = initialCount();
+        hiddenTag = 0;
+    }
+
+    // Deal from a continuous shuffling machine that keeps `tray` cards
+    // waiting to be dealt, 0 for an ideal machine (see the class comment)
+    void useContinuousShuffler(size_t tray) {
+        continuous = true;
+        next = roundStart = trayEnd = 0;
+        trayCards = min(tray, cards.size());
+        while (trayEnd < trayCards) pullIntoTray();
+        running = initialCount();
+        hiddenTag = 0;
+    }
+
+    bool isContinuous() const { return continuous; }
+
+    bool needsShuffle() const { return !continuous && next >= cutCard; }
+
+    // Call between rounds: reshuffles once the cut card has come out, or
+    // hands the last round's cards back to a CSM
+    void prepareRound() {
+        if (continuous) {
+            returnDiscards();
+        } else if (needsShuffle()) {
+            shuffle();
+        }
+        roundStart = next;
+    }
+
+    Card deal() {
+        if (continuous) {
+            if (next == cards.size()) ranDry();
+            // The card dealt plus a full tray behind it
+            size_t filled = min(next + 1 + trayCards, cards.size());
+            while (trayEnd < filled) pullIntoTray();
+        } else if (next == cards.size()) {
+            reshuffleDiscards();
+        }
+        running += tags[static_cast<int>(cards[next].rank)];
+        return cards[next++];
+    }
+
+    // Deal the face-down card; it does not enter the count until revealed
+    Card dealHidden() {
+        Card c = deal();
+        hiddenTag = tags[static_cast<int>(c.rank)];
+        running -= hiddenTag;
+        return c;
+    }
+
+    void revealHidden() {
+        running += hiddenTag;
+        hiddenTag = 0;
+    }
+
+    // Checkpoints: card order, deal position and count, then the
+    // generator. The count system is not saved; attach the same one
+    // before restore(). On failure the shoe is left unusable.
+    void save(string& out) const {
+        putBytes(out, static_cast<uint32_t>(cards.size()));
+        putBytes(out, static_cast<uint32_t>(next));
+        putBytes(out, static_cast<uint32_t>(roundStart));
+        putBytes(out, static_cast<uint32_t>(trayEnd));
+        putBytes(out, static_cast<uint8_t>(continuous));
+        putBytes(out, static_cast<int32_t>(running));
+        putBytes(out, static_cast<int32_t>(hiddenTag));
+        out.append(reinterpret_cast<const char*>(cards.data()),
+                   cards.size() * sizeof(Card));
+        saveGenerator(out);
+    }
+
+    bool restore(const char*& p, const char* end) {
+        uint32_t n = 0, nx = 0, rs = 0, tray = 0;
+        uint8_t csm = 0;
+        int32_t run = 0, hidden = 0;
+        if (!getBytes(p, end, n) || !getBytes(p, end, nx) ||
+            !getBytes(p, end, rs) || !getBytes(p, end, tray) ||
+            !getBytes(p, end, csm) || !getBytes(p, end, run) ||
+            !getBytes(p, end, hidden) || n != cards.size() || nx > n ||
+            rs > nx || tray > n || csm != continuous ||
+            static_cast<size_t>(end - p) < n * sizeof(Card)) {
+            return false;
+        }
+        memcpy(cards.data(), p, n * sizeof(Card));
+        p += n * sizeof(Card);
+        next = nx;
+        roundStart = rs;
+        trayEnd = tray;
+        running = run;
+        hiddenTag = hidden;
+        return loadGenerator(p, end);
+    }
+
+    // Take over another shoe's cards, position and count but keep this
+    // shoe's own generator, so a second strategy can replay a round. A
+    // CSM draws on every card, so there the generator comes along too.
+    void copyDealFrom(const Shoe& other) {
+        *this = other;
+        if (continuous) copyGenerator(other);
+    }
+
+    // Antithetic deal for the next round: the player's two cards and the
+    // dealer's two change places. A fixed reordering of the undealt
+    // cards keeps a fair shuffle fair. Call after prepareRound().
+    void swapInitialDeal() {
+        if (continuous) {
+            size_t filled = min(next + 4, cards.size());
+            while (trayEnd < filled) pullIntoTray();
+        }
+        for (size_t i = next; i + 1 < cards.size() && i < next + 4; i += 2) {
+            swap(cards[i], cards[i + 1]);
+        }
+    }
+
+    int    numDecks() const { return decks; }
+    size_t size() const { return cards.size(); }
+    size_t cardsRemaining() const { return cards.size() - next; }
+
+    // Attach a count system (nullptr to stop counting). Takes effect from
+    // the next shuffle; a fresh shoe always shuffles before its first deal.
+    void setCountSystem(const CountSystem* s) {
+        system = s;
+        for (int i = 0; i < 12; ++i) tags[i] = s ? s->tags[i] : 0;
+        running = initialCount();
+        hiddenTag = 0;
+    }
+
+    const CountSystem* countSystem() const { return system; }
+    int runningCount() const { return running; }
+
+    // Decks not yet dealt, never less than a quarter deck
+    double decksRemaining() const {
+        return max(static_cast<double>(cardsRemaining()) / 52.0, 0.25);
+    }
+
+    // Running count per remaining deck on a level-one scale, so one bet
+    // ramp and one index table serve every system. For an unbalanced
+    // system the expected drift of the count is taken out first.
+    double trueCount() const {
+        if (!system) return 0.0;
+        double dealt = static_cast<double>(next) / 52.0;
+        double balanced = running - initialCount() - system->imbalance * dealt;
+        return balanced / decksRemaining() / system->level;
+    }
+};
+
+template <class Rng>
+class BasicShoe : public Shoe {
+private:
+    Rng rng;
+
+protected:
+    void shuffleCards(Card* first, size_t count) override {
+        fisherYates(first, first + count, rng);
+    }
+
+    uint32_t randomBelow(uint32_t range) override {
+        return boundedRand(rng, range);
+    }
+
+    // Shoes of one run share a generator type
+    void copyGenerator(const Shoe& other) override {
+        rng = static_cast<const BasicShoe&>(other).rng;
+    }
+
+    void saveGenerator(string& out) const override { putBytes(out, rng); }
+
+    bool loadGenerator(const char*& p, const char* end) override {
+        return getBytes(p, end, rng);
+    }
+
+public:
+    BasicShoe(int numDecks, double penetration, const Rng& generator)
+        : Shoe(numDecks, penetration), rng(generator) {}
+
+    BasicShoe(int numDecks, double penetration, uint64_t seed)
+        : BasicShoe(numDecks, penetration, Rng(seed)) {}
+
+    BasicShoe(int numDecks, double penetration)
+        : BasicShoe(numDecks, penetration, freshSeed()) {}
+};
+
+string rngName(RngKind kind) {
+    switch (kind) {
+        case RngKind::Mt19937: return Mt19937Rng::name;
+        case RngKind::Xoshiro: return Xoshiro256ss::name;
+        case RngKind::Pcg:     return Pcg64::name;
+    }
+    return "?";
+}
+
+// Builds a shoe for stream `stream` of a run with the chosen generator
+unique_ptr<Shoe> makeShoe(RngKind kind, int decks, double penetration,
+                          uint64_t master, uint64_t stream) {
+    switch (kind) {
+        case RngKind::Mt19937:
+            return make_unique<BasicShoe<Mt19937Rng>>(
+                decks, penetration, Mt19937Rng::forStream(master, stream));
+        case RngKind::Pcg:
+            return make_unique<BasicShoe<Pcg64>>(
+                decks, penetration, Pcg64::forStream(master, stream));
+        case RngKind::Xoshiro:
+            break;
+    }
+    return make_unique<BasicShoe<Xoshiro256ss>>(
+        decks, penetration, Xoshiro256ss::forStream(master, stream));
+}
+
+// A single deck dealt to the end before it is reshuffled
+class Deck : public BasicShoe<Mt19937Rng> {
+public:
+    Deck() : BasicShoe(1, 1.0) {}
+    explicit Deck(uint64_t seed) : BasicShoe(1, 1.0, seed) {}
+};
+
+// ----------------------- Hand ----------------------------
+// Cards live in fixed inline storage and the totals are updated as each
+// card arrives, so every query below is O(1) and a Hand never allocates.
+class Hand {
+public:
+    // 21 one-point aces plus the card that busts them (8-deck shoe)
+    static constexpr size_t kMaxCards = 22;
+
+private:
+    array<Card, kMaxCards> cards;
+    uint8_t count = 0;
+    uint8_t hardTotal = 0;  // aces counted as 1
+    uint8_t aces = 0;
+    uint8_t value = 0;      // best total, one ace as 11 when it fits
+    bool    soft = false;   // an ace is currently counted as 11
+
+    void updateValue() {
+        soft = aces > 0 && hardTotal + 10 <= 21;
+        value = static_cast<uint8_t>(soft ? hardTotal + 10 : hardTotal);
+    }
+
+    static uint8_t hardValue(const Card& c) {
+        return c.rank == Rank::Ace ? 1 : static_cast<uint8_t>(c.rank);
+    }
+
+public:
+    void clear() {
+        count = hardTotal = aces = value = 0;
+        soft = false;
+    }
+
+    void addCard(const Card& c) {
+        cards[count++] = c;
+        hardTotal = static_cast<uint8_t>(hardTotal + hardValue(c));
+        if (c.rank == Rank::Ace) aces++;
+        updateValue();
+    }
+
+    size_t size() const { return count; }
+
+    const Card& getCard(size_t index) const { return cards[index]; }
+    const Card* begin() const { return cards.data(); }
+    const Card* end() const { return cards.data() + count; }
+
+    // O(1): the last card takes the removed card's slot. Splits remove
+    // the second of two cards, so the order of what is left is unchanged.
+    Card removeCard(size_t index) {
+        Card c = cards[index];
+        cards[index] = cards[--count];
+        hardTotal = static_cast<uint8_t>(hardTotal - hardValue(c));
+        if (c.rank == Rank::Ace) aces--;
+        updateValue();
+        return c;
+    }
+
+    int getValue() const { return value; }
+
+    bool containsAce() const { return aces > 0; }
+
+    bool isSoft() const { return soft; }
+
+    bool isBust() const { return value > 21; }
+
+    bool isBlackjack() const { return count == 2 && value == 21; }
+
+    // No flush here: the console game's prompts flush through cin's tie,
+    // and scripted runs stay block-buffered
+    void show(bool hideFirstCard = false, ostream& out = cout) const {
+        for (size_t i = 0; i < count; ++i) {
+            if (i == 0 && hideFirstCard) {
+                out << "?? ";
+            } else {
+                out << cardToString(cards[i]) << " ";
+            }
+        }
+        if (!hideFirstCard) {
+            out << "(" << getValue() << ")";
+        }
+        out << '\n';
+    }
+};
+
+// -------------------- UI helpers ------------------------
+void showWelcome() {
+    cout << "=====================================\n";
+    cout << "           CASINO BLACKJACK          \n";
+    cout << "=====================================\n";
+    cout << "Rules (program version):\n";
+    cout << " - Single player vs. dealer.\n";
+    cout << " - Dealer hits on 16 or less, stands on 17+.\n";
+    cout << " - Doubling down and splitting pairs allowed.\n";
+    cout << " - Blackjack (Ace + 10-value) pays 3:2.\n";
+    cout << "=====================================\n\n";
+}
+
+double getBet(double bankroll) {
+    double bet;
+    while (true) {
+        cout << "You have $" << bankroll << ". Enter your bet: ";
+        cin >> bet;
+        if (!cin) {
+            cin.clear();
+            cin.ignore(1000, '\n');
+            cout << "Invalid input. Try again.\n";
+            continue;
+        }
+        if (bet <= 0) {
+            cout << "Bet must be positive.\n";
+        } else if (bet > bankroll) {
+            cout << "You cannot bet more than your bankroll.\n";
+        } else {
+            break;
+        }
+    }
+    return bet;
+}
+
+// ----------------------- Rules ---------------------------
+// A rule set is a type. The round engine and the default strategy are
+// templated on it, so every rule check is a compile-time constant and
+// each rule variant gets its own specialised game loop.
+template <int Decks, bool HitSoft17, bool DoubleAfterSplit,
+          int MaxSplits, bool ResplitAces, bool LateSurrender,
+          int BlackjackNum, int BlackjackDen>
+struct RuleSet {
+    static constexpr int  decks            = Decks;
+    static constexpr bool hitSoft17        = HitSoft17;   // dealer hits soft 17
+    static constexpr bool doubleAfterSplit = DoubleAfterSplit;
+    static constexpr int  maxSplits        = MaxSplits;
+    static constexpr int  maxHands         = MaxSplits + 1;
+    static constexpr bool resplitAces      = ResplitAces;
+    static constexpr bool lateSurrender    = LateSurrender;
+    // Winnings per unit bet on a player blackjack (1.5 for 3:2)
+    static constexpr double blackjackPays =
+        static_cast<double>(BlackjackNum) / BlackjackDen;
+};
+
+// The program's rules: single deck, dealer stands on all 17s, one split
+// only, split aces get one card, double after split (but not on split
+// aces), no surrender, blackjack pays 3:2.
+using StandardRules = RuleSet<1, false, true, 1, false, false, 3, 2>;
+
+// Rule choices made on the command line. withRuleSet() maps them onto
+// one of the compiled RuleSet instantiations.
+struct RuleOptions {
+    int  decks = 1;               // 1, 2, 4, 6 or 8
+    bool hitSoft17 = false;
+    bool doubleAfterSplit = true;
+    bool resplit = false;         // up to four hands, aces included
+    bool lateSurrender = false;
+    bool sixToFive = false;       // blackjack pays 6:5 instead of 3:2
+};
+
+bool supportedDeckCount(int decks) {
+    return decks == 1 || decks == 2 || decks == 4 || decks == 6 ||
+           decks == 8;
+}
+
+template <class F>
+void withBool(bool value, F&& f) {
+    if (value) f(true_type{});
+    else       f(false_type{});
+}
+
+template <class F>
+void withDecks(int decks, F&& f) {
+    switch (decks) {
+        case 2:  f(integral_constant<int, 2>{}); break;
+        case 4:  f(integral_constant<int, 4>{}); break;
+        case 6:  f(integral_constant<int, 6>{}); break;
+        case 8:  f(integral_constant<int, 8>{}); break;
+        default: f(integral_constant<int, 1>{}); break;
+    }
+}
+
+// Calls f(RuleSet<...>{}) with the rule set matching `o`
+template <class F>
+void withRuleSet(const RuleOptions& o, F&& f) {
+    withDecks(o.decks, [&](auto decks) {
+    withBool(o.hitSoft17, [&](auto h17) {
+    withBool(o.doubleAfterSplit, [&](auto das) {
+    withBool(o.resplit, [&](auto resplit) {
+    withBool(o.lateSurrender, [&](auto surrender) {
+    withBool(o.sixToFive, [&](auto sixToFive) {
+        constexpr bool rsp = decltype(resplit)::value;
+        constexpr bool six = decltype(sixToFive)::value;
+        f(RuleSet<decltype(decks)::value, decltype(h17)::value,
+                  decltype(das)::value, rsp ? 3 : 1, rsp,
+                  decltype(surrender)::value,
+                  six ? 6 : 3, six ? 5 : 2>{});
+    }); }); }); }); }); });
+}
+
+string describeRules(const RuleOptions& o) {
+    return to_string(o.decks) + " deck(s), " +
+           (o.hitSoft17 ? "H17" : "S17") +
+           (o.doubleAfterSplit ? ", DAS" : ", no DAS") +
+           (o.resplit ? ", resplit to 4 (aces too)" : ", one split") +
+           (o.lateSurrender ? ", late surrender" : "") +
+           (o.sixToFive ? ", BJ 6:5" : ", BJ 3:2");
+}
+
+// ---------------- Basic strategy engine -----------------
+enum class BasicAction { Hit, Stand, DoubleDown, Split, Surrender };
+
+string actionToString(BasicAction a) {
+    switch (a) {
+        case BasicAction::Hit:        return "HIT";
+        case BasicAction::Stand:      return "STAND";
+        case BasicAction::DoubleDown: return "DOUBLE DOWN";
+        case BasicAction::Split:      return "SPLIT";
+        case BasicAction::Surrender:  return "SURRENDER";
+    }
+    return "";
+}
+
+int cardValueForStrategy(const Card& c) {
+    if (c.rank == Rank::Ace) return 11;
+    return static_cast<int>(c.rank);
+}
+
+string cardValueToString(int v) {
+    return v == 11 ? "A" : to_string(v);
+}
+
+bool isPair(const Hand& h) {
+    if (h.size() != 2) return false;
+    return cardValueForStrategy(h.getCard(0)) ==
+           cardValueForStrategy(h.getCard(1));
+}
+
+int dealerUpValue(const Hand& dealer) {
+    if (dealer.size() < 2) return 0;
+    // Second card is face up in our display; 2-10, or 11 for an ace
+    return cardValueForStrategy(dealer.getCard(1));
+}
+
+// ------------------- Strategy charts --------------------
+// A chart cell says what to do for one (hand, dealer upcard) pair.
+// Double and surrender cells name the fallback for when that move is
+// not allowed. Pair rows only use Split or NoSplit (play the hand by
+// its total).
+enum class ChartCell : uint8_t {
+    Hit, Stand, DoubleHit, DoubleStand, Split, NoSplit,
+    SurrenderHit, SurrenderStand
+};
+constexpr int kChartCellKinds = 8;
+
+// Rows are indexed by hand total (hard 4-21, soft 12-21) or by pair
+// card value (2-11); columns by dealer upcard 2-11 at index up - 2.
+struct StrategyChart {
+    static constexpr int kCols = 10;
+    array<array<ChartCell, kCols>, 22> hard{};
+    array<array<ChartCell, kCols>, 22> soft{};
+    array<array<ChartCell, kCols>, 12> pair{};
+};
+
+// The program's rules from the handout, one cell at a time.
+constexpr ChartCell defaultPairCell(int pairVal, int dealerUp) {
+    // Never split 10s, 5s or 4s
+    if (pairVal == 10 || pairVal == 5 || pairVal == 4) {
+        return ChartCell::NoSplit;
+    }
+    // Always split 8s and Aces
+    if (pairVal == 8 || pairVal == 11) return ChartCell::Split;
+    // Other pairs: split vs dealer 2–7
+    return (dealerUp >= 2 && dealerUp <= 7) ? ChartCell::Split
+                                            : ChartCell::NoSplit;
+}
+
+constexpr ChartCell defaultSoftCell(int total, int dealerUp) {
+    // Always hit soft 17 or less
+    if (total <= 17) return ChartCell::Hit;
+    // Hit soft 18 vs dealer 9, 10 or Ace
+    if (total == 18) {
+        return (dealerUp >= 9) ? ChartCell::Hit : ChartCell::Stand;
+    }
+    // Soft 19+ stand
+    return ChartCell::Stand;
+}
+
+constexpr ChartCell defaultHardCell(int total, int dealerUp) {
+    // Always double 11
+    if (total == 11) return ChartCell::DoubleHit;
+    // Double 10 unless dealer 10 or Ace
+    if (total == 10) {
+        return (dealerUp <= 9) ? ChartCell::DoubleHit : ChartCell::Hit;
+    }
+    // Double 9 vs dealer 2–6
+    if (total == 9) {
+        return (dealerUp <= 6) ? ChartCell::DoubleHit : ChartCell::Hit;
+    }
+    if (total <= 11) return ChartCell::Hit;
+    // 12–16: stand vs 2–6, otherwise hit
+    if (total <= 16) {
+        return (dealerUp <= 6) ? ChartCell::Stand : ChartCell::Hit;
+    }
+    // 17 or more – stand
+    return ChartCell::Stand;
+}
+
+template <class Rules>
+constexpr StrategyChart makeDefaultChart() {
+    StrategyChart chart{};
+    for (int up = 2; up <= 11; ++up) {
+        int col = up - 2;
+        for (int t = 0; t < 22; ++t) {
+            chart.hard[t][col] = defaultHardCell(t, up);
+            chart.soft[t][col] = defaultSoftCell(t, up);
+        }
+        for (int v = 0; v < 12; ++v) {
+            chart.pair[v][col] = defaultPairCell(v, up);
+        }
+    }
+    if constexpr (Rules::lateSurrender) {
+        // Surrender 16 vs 9, 10, A and 15 vs 10 (and vs A if H17)
+        chart.hard[16][9 - 2]  = ChartCell::SurrenderHit;
+        chart.hard[16][10 - 2] = ChartCell::SurrenderHit;
+        chart.hard[16][11 - 2] = ChartCell::SurrenderHit;
+        chart.hard[15][10 - 2] = ChartCell::SurrenderHit;
+        if constexpr (Rules::hitSoft17) {
+            chart.hard[15][11 - 2] = ChartCell::SurrenderHit;
+            chart.hard[17][11 - 2] = ChartCell::SurrenderStand;
+        }
+    }
+    return chart;
+}
+
+// Default chart for each rule set, built at compile time
+template <class Rules>
+inline constexpr StrategyChart kRulesChart = makeDefaultChart<Rules>();
+
+constexpr StrategyChart kDefaultChart = makeDefaultChart<StandardRules>();
+
+// Chart used by basicStrategySuggestion(). Replaced (if at all) once at
+// startup from --strategy, before any simulation thread starts; a
+// loaded chart also replaces the per-rule-set defaults.
+StrategyChart activeChart = kDefaultChart;
+bool activeChartLoaded = false;
+
+// Action for a cell, indexed [cell][canDouble + 2 * canSurrender]
+constexpr BasicAction kCellAction[kChartCellKinds][4] = {
+    // Hit
+    { BasicAction::Hit, BasicAction::Hit, BasicAction::Hit, BasicAction::Hit },
+    // Stand
+    { BasicAction::Stand, BasicAction::Stand,
+      BasicAction::Stand, BasicAction::Stand },
+    // DoubleHit
+    { BasicAction::Hit, BasicAction::DoubleDown,
+      BasicAction::Hit, BasicAction::DoubleDown },
+    // DoubleStand
+    { BasicAction::Stand, BasicAction::DoubleDown,
+      BasicAction::Stand, BasicAction::DoubleDown },
+    // Split
+    { BasicAction::Split, BasicAction::Split,
+      BasicAction::Split, BasicAction::Split },
+    // NoSplit
+    { BasicAction::Hit, BasicAction::Hit, BasicAction::Hit, BasicAction::Hit },
+    // SurrenderHit
+    { BasicAction::Hit, BasicAction::Hit,
+      BasicAction::Surrender, BasicAction::Surrender },
+    // SurrenderStand
+    { BasicAction::Stand, BasicAction::Stand,
+      BasicAction::Surrender, BasicAction::Surrender },
+};
+
+BasicAction chartSuggestion(const StrategyChart& chart, const Hand& hand,
+                            int dealerUp, bool canDouble, bool canSplit,
+                            bool canSurrender = false) {
+    int col = min(max(dealerUp, 2), 11) - 2;
+    if (canSplit && isPair(hand)) {
+        int pairVal = cardValueForStrategy(hand.getCard(0));
+        if (chart.pair[pairVal][col] == ChartCell::Split) {
+            return BasicAction::Split;
+        }
+    }
+    int total = hand.getValue();
+    if (total > 21) return BasicAction::Stand;
+    ChartCell cell = hand.isSoft() ? chart.soft[total][col]
+                                   : chart.hard[total][col];
+    return kCellAction[static_cast<int>(cell)]
+                      [(canDouble ? 1 : 0) + (canSurrender ? 2 : 0)];
+}
+
+// Implements the rules from your handout (soft hand, doubling, splitting)
+// through the active chart.
+BasicAction basicStrategySuggestion(const Hand& hand,
+                                    int dealerUp,
+                                    bool canDouble,
+                                    bool canSplit,
+                                    bool canSurrender = false) {
+    return chartSuggestion(activeChart, hand, dealerUp,
+                           canDouble, canSplit, canSurrender);
+}
+
+// Basic strategy for a rule set: its compile-time default chart, unless
+// a chart was loaded at startup.
+template <class Rules>
+BasicAction basicStrategyFor(const Hand& hand, int dealerUp, bool canDouble,
+                             bool canSplit, bool canSurrender) {
+    const StrategyChart& chart =
+        activeChartLoaded ? activeChart : kRulesChart<Rules>;
+    return chartSuggestion(chart, hand, dealerUp,
+                           canDouble, canSplit, canSurrender);
+}
+
+// ---------------- Chart files ---------------------------
+// Plain text, one row per line, '#' starts a comment:
+//     hard 12  H H S S S H H H H H
+//     soft 18  S Ds Ds Ds Ds S S H H H
+//     pair A   P P P P P P P P P P
+// A row is a hand kind, a total (or pair card, A for aces) and ten
+// cells for dealer 2-10 and A. Cells: H hit, S stand, D double else
+// hit, Ds double else stand, Rh surrender else hit, Rs surrender else
+// stand, P split, - don't split. Rows that are not listed keep their
+// current value.
+string cellToString(ChartCell c) {
+    switch (c) {
+        case ChartCell::Hit:         return "H";
+        case ChartCell::Stand:       return "S";
+        case ChartCell::DoubleHit:   return "D";
+        case ChartCell::DoubleStand: return "Ds";
+        case ChartCell::Split:       return "P";
+        case ChartCell::NoSplit:     return "-";
+        case ChartCell::SurrenderHit:   return "Rh";
+        case ChartCell::SurrenderStand: return "Rs";
+    }
+    return "?";
+}
+
+bool parseCell(const string& text, ChartCell& cell) {
+    for (int i = 0; i < kChartCellKinds; ++i) {
+        ChartCell c = static_cast<ChartCell>(i);
+        if (text == cellToString(c)) { cell = c; return true; }
+    }
+    return false;
+}
+
+void writeStrategyChart(ostream& out, const StrategyChart& chart) {
+    auto pad = [](string text, size_t width) {
+        return text + string(width > text.size() ? width - text.size() : 0,
+                             ' ');
+    };
+    auto row = [&out, &pad](const string& label,
+                            const array<ChartCell, StrategyChart::kCols>& cells) {
+        out << pad(label, 7);
+        for (int col = 0; col < StrategyChart::kCols; ++col) {
+            string text = cellToString(cells[col]);
+            out << " " << (col + 1 < StrategyChart::kCols ? pad(text, 2) : text);
+        }
+        out << "\n";
+    };
+    out << "#       2  3  4  5  6  7  8  9  10 A   <- dealer upcard\n";
+    for (int t = 4; t <= 21; ++t) {
+        row("hard " + to_string(t), chart.hard[t]);
+    }
+    for (int t = 12; t <= 21; ++t) {
+        row("soft " + to_string(t), chart.soft[t]);
+    }
+    for (int v = 2; v <= 11; ++v) {
+        row("pair " + (v == 11 ? string("A") : to_string(v)), chart.pair[v]);
+    }
+}
+
+// Reads a chart file over `chart`. On failure `chart` is unchanged and
+// `error` says which line was rejected.
+bool loadStrategyChart(const string& path, StrategyChart& chart,
+                       string& error) {
+    ifstream in(path);
+    if (!in) {
+        error = "cannot open " + path;
+        return false;
+    }
+    StrategyChart loaded = chart;
+    string line;
+    int lineNo = 0;
+    while (getline(in, line)) {
+        ++lineNo;
+        line = line.substr(0, line.find('#'));
+        istringstream row(line);
+        string kind, label;
+        if (!(row >> kind)) continue;
+        row >> label;
+
+        int index = (label == "A") ? 11 : atoi(label.c_str());
+        array<ChartCell, StrategyChart::kCols>* target = nullptr;
+        if (kind == "hard" && index >= 4 && index <= 21) {
+            target = &loaded.hard[index];
+        } else if (kind == "soft" && index >= 12 && index <= 21) {
+            target = &loaded.soft[index];
+        } else if (kind == "pair" && index >= 2 && index <= 11) {
+            target = &loaded.pair[index];
+        }
+        if (!target) {
+            error = path + ":" + to_string(lineNo) + ": bad row '" +
+                    kind + " " + label + "'";
+            return false;
+        }
+
+        bool isPairRow = (kind == "pair");
+        for (int col = 0; col < StrategyChart::kCols; ++col) {
+            string text;
+            ChartCell cell;
+            bool ok = (row >> text) && parseCell(text, cell) &&
+                      isPairRow == (cell == ChartCell::Split ||
+                                    cell == ChartCell::NoSplit);
+            if (!ok) {
+                error = path + ":" + to_string(lineNo) +
+                        ": bad cell for dealer " +
+                        (col == 9 ? string("A") : to_string(col + 2));
+                return false;
+            }
+            (*target)[col] = cell;
+        }
+    }
+    chart = loaded;
+    return true;
+}
+
+// Ask the player for action, checking which moves are legal
+char getPlayerChoice(bool canHit, bool canStand,
+                     bool canDouble, bool canSplit,
+                     bool canSurrender = false) {
+    while (true) {
+        cout << "Choose action: ";
+        if (canHit)       cout << "(H)it, ";
+        if (canStand)     cout << "(S)tand";
+        if (canDouble)    cout << ", (D)ouble";
+        if (canSplit)     cout << ", S(P)lit";
+        if (canSurrender) cout << ", Su(R)render";
+        cout << ": ";
+
+        char ch;
+        cin >> ch;
+        ch = static_cast<char>(toupper(static_cast<unsigned char>(ch)));
+
+        if (ch == 'H' && canHit)    return ch;
+        if (ch == 'S' && canStand)  return ch;
+        if (ch == 'D' && canDouble) return ch;
+        if (ch == 'P' && canSplit)  return ch;
+        if (ch == 'R' && canSurrender) return ch;
+
+        cout << "Invalid choice, try again.\n";
+    }
+}
+
+// ------------------- Round observers --------------------
+// The round engine reports every step to an observer. The console
+// observer prints the interactive game (or a script transcript) to its
+// stream; the null observer compiles away so simulated rounds do no I/O
+// at all.
+struct NullObserver {
+    void onInitialDeal(const Hand&, const Hand&, double, double) {}
+    void onNatural(const Hand&, bool, bool) {}
+    void onTurn(size_t, const Hand&, const Hand&) {}
+    void onHit(const Card&, const Hand&) {}
+    void onDouble(const Card&, const Hand&) {}
+    void onSplit(const Hand&, const Hand&, bool) {}
+    void onSurrender() {}
+    void onAllBust() {}
+    void onDealerStart(const Hand&) {}
+    void onDealerDraw(const Card&, const Hand&) {}
+    void onResult(size_t, const Hand&, const Hand&, bool, double) {}
+};
+
+struct ConsoleObserver {
+    ostream* out = &cout;
+
+    void onInitialDeal(const Hand& dealer, const Hand& hand,
+                       double bankroll, double bet) {
+        *out << "Dealer's hand: ";
+        dealer.show(true, *out);
+        *out << "Your hand: ";
+        hand.show(false, *out);
+
+        BasicAction sugg =
+            basicStrategySuggestion(hand, dealerUpValue(dealer),
+                /*canDouble*/ bankroll >= bet && hand.size() == 2,
+                /*canSplit*/  bankroll >= bet && isPair(hand));
+        *out << "[Basic Strategy Suggestion] "
+             << actionToString(sugg) << "\n";
+    }
+
+    void onNatural(const Hand& dealer, bool playerBlackjack,
+                   bool dealerBlackjack) {
+        *out << "\n--- Checking for Blackjack ---\n";
+        *out << "Dealer's full hand: ";
+        dealer.show(false, *out);
+
+        if (playerBlackjack && dealerBlackjack) {
+            *out << "Both you and the dealer have Blackjack. Push.\n";
+        } else if (playerBlackjack) {
+            *out << "You have Blackjack! You win 1.5x your bet.\n";
+        } else {
+            *out << "Dealer has Blackjack. You lose.\n";
+        }
+    }
+
+    void onTurn(size_t h, const Hand& dealer, const Hand& hand) {
+        *out << "\n--- Playing Hand " << (h + 1) << " ---\n";
+        *out << "Dealer shows: ";
+        dealer.show(true, *out);
+        *out << "Your hand: ";
+        hand.show(false, *out);
+    }
+
+    void onHit(const Card& c, const Hand& hand) {
+        *out << "You draw: " << cardToString(c) << "\n";
+        *out << "Your hand: ";
+        hand.show(false, *out);
+        if (hand.isBust()) {
+            *out << "You bust on this hand.\n";
+        }
+    }
+
+    void onDouble(const Card& c, const Hand& hand) {
+        *out << "You double down and draw: " << cardToString(c) << "\n";
+        *out << "Your hand: ";
+        hand.show(false, *out);
+        if (hand.isBust()) {
+            *out << "You bust on this hand.\n";
+        }
+    }
+
+    void onSplit(const Hand& first, const Hand& second, bool splitAces) {
+        *out << "You choose to split the pair.\n";
+        *out << "Hand 1 after split: ";
+        first.show(false, *out);
+        *out << "Hand 2 after split: ";
+        second.show(false, *out);
+        if (splitAces) {
+            *out << "Split aces: each hand gets "
+                    "one card only, no further hits.\n";
+        }
+    }
+
+    void onSurrender() {
+        *out << "You surrender and get half your bet back.\n";
+    }
+
+    void onAllBust() {
+        *out << "\nAll your hands busted. Dealer wins automatically.\n";
+    }
+
+    void onDealerStart(const Hand& dealer) {
+        *out << "\nDealer's turn...\n";
+        *out << "Dealer's hand: ";
+        dealer.show(false, *out);
+    }
+
+    void onDealerDraw(const Card& c, const Hand& dealer) {
+        *out << "Dealer draws: " << cardToString(c) << "\n";
+        *out << "Dealer's hand: ";
+        dealer.show(false, *out);
+    }
+
+    void onResult(size_t h, const Hand& hand, const Hand& dealer,
+                  bool dealerBust, double bet) {
+        *out << "\n--- Result for Hand " << (h + 1) << " ---\n";
+        *out << "Your hand: ";
+        hand.show(false, *out);
+        *out << "Dealer: ";
+        dealer.show(false, *out);
+
+        if (hand.isBust()) {
+            *out << "You busted. You lose this bet of $" << bet << ".\n";
+        } else if (dealerBust) {
+            *out << "Dealer busts. You win!\n";
+        } else if (hand.getValue() > dealer.getValue()) {
+            *out << "You beat the dealer!\n";
+        } else if (hand.getValue() < dealer.getValue()) {
+            *out << "Dealer wins this hand.\n";
+        } else {
+            *out << "Push on this hand. Your bet is returned.\n";
+        }
+    }
+};
+
+// Console decision callback: shows the suggestion, then asks the player
+BasicAction consoleDecision(const Hand& hand, int dealerUp,
+                            bool canDouble, bool canSplit,
+                            bool canSurrender) {
+    BasicAction suggestion =
+        basicStrategySuggestion(hand, dealerUp, canDouble, canSplit,
+                                canSurrender);
+    cout << "[Basic Strategy Suggestion] "
+         << actionToString(suggestion) << "\n";
+
+    char choice = getPlayerChoice(true, true, canDouble, canSplit,
+                                  canSurrender);
+    switch (choice) {
+        case 'S': return BasicAction::Stand;
+        case 'D': return BasicAction::DoubleDown;
+        case 'P': return BasicAction::Split;
+        case 'R': return BasicAction::Surrender;
+        default:  return BasicAction::Hit;
+    }
+}
+
+// --------------------- Round engine ---------------------
+// Compact summary of one round, all amounts relative to the bankroll
+// the round started with.
+struct RoundOutcome {
+    double net     = 0.0;   // bankroll change (stake + winnings - bets)
+    double wagered = 0.0;   // total staked, including doubles and splits
+    int    hands   = 1;     // player hands played (more after a split)
+    int    dealerTotal = 0;
+    bool   playerBlackjack = false;
+    bool   dealerBlackjack = false;
+    bool   dealerBust      = false;
+    bool   allBust         = false;
+    bool   surrendered     = false;
+};
+
+// Per-round state for one seat, allocated once and reused every round.
+// The player's hands are a structure of arrays with room for the most
+// hands the rules allow; the per-hand flags are bits in one byte each.
+// reset() is O(1): it only clears counters, and each Hand is cleared
+// when it is handed out again. The decisions taken are logged as bytes
+// (hand index << 4 | action) for the hand history.
+template <int MaxHands>
+struct RoundState {
+    static_assert(MaxHands >= 1 && MaxHands <= 8, "flags are 8-bit masks");
+    static constexpr int kMaxHands = MaxHands;
+    static constexpr int kMaxActions = 24;
+
+    Hand dealer;
+    array<Hand, MaxHands>   hands;
+    array<double, MaxHands> bets;
+    array<double, MaxHands> handNet;  // result of each hand, once settled
+    uint8_t count = 0;
+    uint8_t finished = 0;       // bit h: hand h needs no more decisions
+    uint8_t splitAces = 0;      // bit h: hand h came from split aces
+    array<uint8_t, kMaxActions> actions;
+    uint8_t actionCount = 0;    // may exceed kMaxActions; extras are dropped
+
+    void reset() {
+        dealer.clear();
+        count = 0;
+        finished = splitAces = 0;
+        actionCount = 0;
+    }
+
+    void logAction(size_t h, BasicAction a) {
+        if (actionCount < kMaxActions) {
+            actions[actionCount] = static_cast<uint8_t>(
+                (h << 4) | static_cast<unsigned>(a));
+        }
+        if (actionCount < 255) actionCount++;
+    }
+
+    size_t size() const { return count; }
+
+    bool isFinished(size_t h) const { return (finished >> h) & 1u; }
+    void setFinished(size_t h, bool on = true) { setBit(finished, h, on); }
+
+    bool fromSplitAces(size_t h) const { return (splitAces >> h) & 1u; }
+    void setSplitAces(size_t h, bool on) { setBit(splitAces, h, on); }
+
+    void addHand(double bet) {
+        hands[count].clear();
+        bets[count] = bet;
+        count++;
+    }
+
+    // Open an empty hand at h + 1, shifting the later hands up by one
+    void insertAfter(size_t h, double bet) {
+        for (size_t k = count; k > h + 1; --k) {
+            hands[k] = hands[k - 1];
+            bets[k] = bets[k - 1];
+        }
+        uint8_t low = static_cast<uint8_t>((1u << (h + 1)) - 1);
+        finished  = static_cast<uint8_t>((finished & low) |
+                                          ((finished & ~low) << 1));
+        splitAces = static_cast<uint8_t>((splitAces & low) |
+                                          ((splitAces & ~low) << 1));
+        hands[h + 1].clear();
+        bets[h + 1] = bet;
+        count++;
+    }
+
+private:
+    static void setBit(uint8_t& mask, size_t h, bool on) {
+        if (on) mask = static_cast<uint8_t>(mask | (1u << h));
+        else    mask = static_cast<uint8_t>(mask & ~(1u << h));
+    }
+};
+
+// Plays one round of blackjack under `Rules`. The round is a small
+// state machine: begin() deals, apply() takes one decision at a time
+// while awaitingDecision() is true, finish() plays the dealer and
+// settles. play() drives the whole thing from a decision callback with
+// the same signature as basicStrategySuggestion().
+template <class Rules, class Observer = NullObserver>
+class RoundEngine {
+private:
+    Shoe*  deck = nullptr;
+    Observer obs;
+
+    RoundState<Rules::maxHands> st;
+    size_t current   = 0;
+    double available = 0.0;  // bankroll left for doubles and splits
+    bool   natural   = false;
+    RoundOutcome outcome;
+
+    // Move `current` to the next hand that still needs decisions
+    void advance() {
+        while (current < st.size() &&
+               (st.isFinished(current) || st.hands[current].isBust())) {
+            ++current;
+        }
+    }
+
+    bool allHandsBust() const {
+        for (size_t h = 0; h < st.size(); ++h) {
+            if (!st.hands[h].isBust()) return false;
+        }
+        return true;
+    }
+
+public:
+    RoundEngine() = default;
+    explicit RoundEngine(const Observer& o) : obs(o) {}
+
+    static bool dealerHits(const Hand& dealer) {
+        int v = dealer.getValue();
+        if constexpr (Rules::hitSoft17) {
+            return v < 17 || (v == 17 && dealer.isSoft());
+        } else {
+            return v < 17;
+        }
+    }
+
+    // Deal a new round. `bankroll` is the player's money including `bet`.
+    void begin(Shoe& d, double bet, double bankroll) {
+        d.prepareRound();
+        BLACKJACK_PHASE(Deal);
+        seat(d, bet, bankroll);
+
+        // Initial deal: player and dealer
+        Hand dealer;
+        dealTo(deck->deal());
+        dealer.addCard(deck->dealHidden());  // hole card
+        dealTo(deck->deal());
+        dealer.addCard(deck->deal());
+        checkNaturals(dealer);
+    }
+
+    // The steps of begin() and finish(), for a table that deals several
+    // seats and plays one dealer for all of them: seat(), then dealTo()
+    // twice, checkNaturals() once the dealer has two cards, decisions,
+    // and settle() after the dealer (if needsDealer()) has played.
+
+    // Take a seat for a round with no cards yet
+    void seat(Shoe& d, double bet, double bankroll) {
+        deck = &d;
+        available = bankroll - bet;
+        outcome = RoundOutcome{};
+        outcome.net = -bet;
+        outcome.wagered = bet;
+        natural = false;
+
+        st.reset();
+        st.addHand(bet);
+        current = 0;
+    }
+
+    void dealTo(const Card& c) { st.hands[0].addCard(c); }
+
+    // `dealer` holds the hole card (first) and the upcard
+    void checkNaturals(const Hand& dealer) {
+        st.dealer = dealer;
+        double bet = st.bets[0];
+        obs.onInitialDeal(st.dealer, st.hands[0], available, bet);
+
+        outcome.playerBlackjack = st.hands[0].isBlackjack();
+        outcome.dealerBlackjack = st.dealer.isBlackjack();
+        natural = outcome.playerBlackjack || outcome.dealerBlackjack;
+
+        // ----------- Natural blackjack check --------------
+        if (natural) {
+            obs.onNatural(st.dealer, outcome.playerBlackjack,
+                          outcome.dealerBlackjack);
+            if (outcome.playerBlackjack && outcome.dealerBlackjack) {
+                outcome.net += bet;  // return original bet
+            } else if (outcome.playerBlackjack) {
+                // stake + blackjack winnings
+                outcome.net += bet * (1.0 + Rules::blackjackPays);
+            }
+            st.handNet[0] = outcome.net;
+            current = st.size();
+        }
+    }
+
+    // Whether some hand is still live against the dealer's play-out
+    bool needsDealer() const {
+        return !natural && !outcome.surrendered && !allHandsBust();
+    }
+
+    bool awaitingDecision() const { return current < st.size(); }
+
+    size_t currentIndex() const { return current; }
+    const Hand& currentHand() const { return st.hands[current]; }
+    const Hand& dealerHand() const { return st.dealer; }
+    int dealerUp() const { return dealerUpValue(st.dealer); }
+    const RoundState<Rules::maxHands>& roundState() const { return st; }
+
+    // Split aces get one card each and can only be split again (RSA)
+    bool canHit() const { return !st.fromSplitAces(current); }
+
+    bool canDouble() const {
+        if constexpr (!Rules::doubleAfterSplit) {
+            if (st.size() > 1) return false;
+        }
+        return st.hands[current].size() == 2 &&
+               available >= st.bets[current] &&
+               !st.fromSplitAces(current);
+    }
+
+    bool canSplit() const {
+        if constexpr (!Rules::resplitAces) {
+            if (st.fromSplitAces(current)) return false;
+        }
+        return st.size() < static_cast<size_t>(Rules::maxHands) &&
+               st.hands[current].size() == 2 &&
+               isPair(st.hands[current]) &&
+               available >= st.bets[current];
+    }
+
+    // Late surrender: first two cards of the original hand only
+    bool canSurrender() const {
+        if constexpr (Rules::lateSurrender) {
+            return st.size() == 1 && st.hands[0].size() == 2;
+        } else {
+            return false;
+        }
+    }
+
+    // Apply one decision to the current hand. Returns false (and changes
+    // nothing) when the action is not allowed right now.
+    bool apply(BasicAction action) {
+        if (!awaitingDecision()) return false;
+        size_t h = current;
+
+        if (action == BasicAction::Hit) {
+            if (!canHit()) return false;
+            Card c = deck->deal();
+            st.hands[h].addCard(c);
+            obs.onHit(c, st.hands[h]);
+            if (st.hands[h].isBust()) {
+                BLACKJACK_COUNT(PlayerBusts);
+                st.setFinished(h);
+            }
+        } else if (action == BasicAction::Stand) {
+            st.setFinished(h);
+        } else if (action == BasicAction::DoubleDown) {
+            if (!canDouble()) return false;
+            BLACKJACK_COUNT(Doubles);
+            // Double bet, one more card only
+            available -= st.bets[h];
+            outcome.net -= st.bets[h];
+            outcome.wagered += st.bets[h];
+            st.bets[h] *= 2;
+            Card c = deck->deal();
+            st.hands[h].addCard(c);
+            obs.onDouble(c, st.hands[h]);
+            if (st.hands[h].isBust()) BLACKJACK_COUNT(PlayerBusts);
+            st.setFinished(h);
+        } else if (action == BasicAction::Surrender) {
+            if (!canSurrender()) return false;
+            outcome.net += st.bets[h] / 2;  // half the bet comes back
+            outcome.surrendered = true;
+            st.handNet[h] = -st.bets[h] / 2;
+            obs.onSurrender();
+            st.setFinished(h);
+        } else {
+            if (!canSplit()) return false;
+            BLACKJACK_COUNT(Splits);
+            // Pay additional bet for new hand
+            available -= st.bets[h];
+            outcome.net -= st.bets[h];
+            outcome.wagered += st.bets[h];
+
+            // New hand right after current, from the second card
+            st.insertAfter(h, st.bets[h]);
+            Card moved = st.hands[h].removeCard(1);
+            st.hands[h + 1].addCard(moved);
+
+            // Deal one extra card to each split hand
+            st.hands[h].addCard(deck->deal());
+            st.hands[h + 1].addCard(deck->deal());
+
+            bool splitAces = (cardValueForStrategy(moved) == 11);
+            st.setSplitAces(h, splitAces);
+            st.setSplitAces(h + 1, splitAces);
+            outcome.hands = static_cast<int>(st.size());
+
+            obs.onSplit(st.hands[h], st.hands[h + 1], splitAces);
+
+            if (splitAces) {
+                // Split aces: only one card per hand, no hits. With RSA
+                // a hand that caught another ace stays open for a split.
+                for (size_t k = h; k <= h + 1; ++k) {
+                    st.setFinished(k);
+                    if constexpr (Rules::resplitAces) {
+                        current = k;
+                        if (canSplit()) st.setFinished(k, false);
+                        current = h;
+                    }
+                }
+            }
+        }
+        st.logAction(h, action);
+        advance();
+        return true;
+    }
+
+    // Dealer plays (only if some hand is alive) and every hand is settled
+    RoundOutcome finish() {
+        deck->revealHidden();
+        if (needsDealer()) {
+            BLACKJACK_PHASE(Dealer);
+            obs.onDealerStart(st.dealer);
+            while (dealerHits(st.dealer)) {
+                Card c = deck->deal();
+                st.dealer.addCard(c);
+                obs.onDealerDraw(c, st.dealer);
+            }
+            if (st.dealer.isBust()) BLACKJACK_COUNT(DealerBusts);
+        }
+        return settle(st.dealer);
+    }
+
+    // Settle every hand against the dealer's final hand
+    RoundOutcome settle(const Hand& dealer) {
+        BLACKJACK_PHASE(Settle);
+        BLACKJACK_COUNT(Rounds);
+        st.dealer = dealer;
+        if (natural || outcome.surrendered) return outcome;
+
+        if (allHandsBust()) {
+            outcome.allBust = true;
+            for (size_t h = 0; h < st.size(); ++h) st.handNet[h] = -st.bets[h];
+            obs.onAllBust();
+            return outcome;
+        }
+
+        int dealerTotal = st.dealer.getValue();
+        bool dealerBust = st.dealer.isBust();
+        outcome.dealerTotal = dealerTotal;
+        outcome.dealerBust = dealerBust;
+
+        // --------- Resolve each hand separately -------------
+        for (size_t h = 0; h < st.size(); ++h) {
+            obs.onResult(h, st.hands[h], st.dealer, dealerBust, st.bets[h]);
+            double back = 0.0;  // paid back on this hand
+            if (!st.hands[h].isBust()) {
+                int pTotal = st.hands[h].getValue();
+                if (dealerBust || pTotal > dealerTotal) {
+                    back = st.bets[h] * 2;  // stake + win
+                } else if (pTotal == dealerTotal) {
+                    back = st.bets[h];      // push: bet is returned
+                }
+            }
+            outcome.net += back;
+            st.handNet[h] = back - st.bets[h];
+        }
+        return outcome;
+    }
+
+    // Play a full round, asking `decide` for every player decision
+    template <class Decide>
+    RoundOutcome play(Shoe& d, double bet, double bankroll,
+                      Decide&& decide) {
+        begin(d, bet, bankroll);
+        while (awaitingDecision()) {
+            BLACKJACK_PHASE(Decision);
+            obs.onTurn(current, st.dealer, st.hands[current]);
+            BasicAction a = decide(st.hands[current], dealerUp(),
+                                   canDouble(), canSplit(), canSurrender());
+            // An illegal request takes a card if it may, else stands
+            if (!apply(a) && !apply(BasicAction::Hit)) {
+                apply(BasicAction::Stand);
+            }
+        }
+        return finish();
+    }
+};
+
+// ------------------------ Table -------------------------
+// Up to seven seats against one dealer, dealt from one shoe in casino
+// order: a card to each seat from the first seat on, the dealer's
+// upcard, a second card to each seat, then the dealer's hole card. Seats
+// play in turn, the dealer plays once for everyone still live, and each
+// seat is settled against the same dealer hand. The dealer Hand keeps
+// the hole card at index 0, as dealerUpValue() expects.
+template <class Rules>
+class TableEngine {
+public:
+    static constexpr int kMaxSeats = 7;
+
+    // Same signature as basicStrategySuggestion()
+    using Strategy = BasicAction (*)(const Hand&, int, bool, bool, bool);
+
+    struct Seat {
+        Strategy strategy = basicStrategyFor<Rules>;
+        double   bankroll = numeric_limits<double>::infinity();
+        double   bet = 1.0;
+    };
+
+private:
+    array<RoundEngine<Rules>, kMaxSeats> engines;
+    array<Seat, kMaxSeats>         seats;
+    array<RoundOutcome, kMaxSeats> outcomes;
+    uint8_t count = 0;
+    uint8_t playing = 0;  // bit i: seat i had a bet down this round
+    Hand    dealer;
+
+public:
+    // Returns the new seat's index, or -1 if the table is full
+    int addSeat(const Seat& s) {
+        if (count == kMaxSeats) return -1;
+        seats[count] = s;
+        return count++;
+    }
+
+    size_t size() const { return count; }
+    Seat& seat(size_t i) { return seats[i]; }
+    const Seat& seat(size_t i) const { return seats[i]; }
+    const Hand& dealerHand() const { return dealer; }
+
+    // Whether seat i played the last round (it sits out when its
+    // bankroll cannot cover its bet)
+    bool played(size_t i) const { return (playing >> i) & 1u; }
+    const RoundOutcome& outcome(size_t i) const { return outcomes[i]; }
+    const RoundEngine<Rules>& seatEngine(size_t i) const { return engines[i]; }
+
+    // Deal, play and settle one round; every seat's bankroll is updated
+    void playRound(Shoe& shoe) {
+        shoe.prepareRound();
+        playing = 0;
+        for (size_t i = 0; i < count; ++i) {
+            outcomes[i] = RoundOutcome{};
+            outcomes[i].hands = 0;
+            if (seats[i].bet > 0.0 && seats[i].bankroll >= seats[i].bet) {
+                engines[i].seat(shoe, seats[i].bet, seats[i].bankroll);
+                playing = static_cast<uint8_t>(playing | (1u << i));
+            }
+        }
+        if (!playing) return;
+
+        {
+            BLACKJACK_PHASE(Deal);
+            for (size_t i = 0; i < count; ++i) {
+                if (played(i)) engines[i].dealTo(shoe.deal());
+            }
+            Card up = shoe.deal();
+            for (size_t i = 0; i < count; ++i) {
+                if (played(i)) engines[i].dealTo(shoe.deal());
+            }
+            dealer.clear();
+            dealer.addCard(shoe.dealHidden());
+            dealer.addCard(up);
+        }
+
+        bool live = false;
+        for (size_t i = 0; i < count; ++i) {
+            if (!played(i)) continue;
+            RoundEngine<Rules>& e = engines[i];
+            e.checkNaturals(dealer);
+            while (e.awaitingDecision()) {
+                BLACKJACK_PHASE(Decision);
+                BasicAction a = seats[i].strategy(
+                    e.currentHand(), e.dealerUp(), e.canDouble(),
+                    e.canSplit(), e.canSurrender());
+                // An illegal request takes a card if it may, else stands
+                if (!e.apply(a) && !e.apply(BasicAction::Hit)) {
+                    e.apply(BasicAction::Stand);
+                }
+            }
+            live |= e.needsDealer();
+        }
+
+        shoe.revealHidden();
+        if (live) {
+            BLACKJACK_PHASE(Dealer);
+            while (RoundEngine<Rules>::dealerHits(dealer)) {
+                dealer.addCard(shoe.deal());
+            }
+            if (dealer.isBust()) BLACKJACK_COUNT(DealerBusts);
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (!played(i)) continue;
+            outcomes[i] = engines[i].settle(dealer);
+            seats[i].bankroll += outcomes[i].net;
+        }
+    }
+};
+
+// ------------------- Card counting ----------------------
+// Counted play: the bet for a round follows a ramp on the true count
+// when the round starts, and decisions may take count-indexed
+// deviations from the chart. True counts are floored and clamped to
+// +-kMaxTrueCount, which is also the range the statistics are kept in.
+constexpr int kMaxTrueCount = 10;
+
+int trueCountBucket(double trueCount) {
+    int tc = static_cast<int>(floor(trueCount));
+    return min(max(tc, -kMaxTrueCount), kMaxTrueCount);
+}
+
+// Bet in base units by true count. Each step holds from its count up to
+// the next step; below the first step the bet is one unit.
+struct BetRamp {
+    vector<pair<int, double>> steps;  // (true count, units), ascending
+
+    double betFor(int trueCount) const {
+        double bet = 1.0;
+        for (const auto& s : steps) {
+            if (trueCount < s.first) break;
+            bet = s.second;
+        }
+        return bet;
+    }
+};
+
+// 1-8 spread starting at +2
+BetRamp defaultBetRamp() {
+    return BetRamp{ { {2, 2.0}, {3, 4.0}, {4, 6.0}, {5, 8.0} } };
+}
+
+string describeRamp(const BetRamp& ramp) {
+    ostringstream out;
+    out << "1";
+    for (const auto& s : ramp.steps) {
+        out << ", " << s.second << " at " << (s.first > 0 ? "+" : "")
+            << s.first;
+    }
+    return out.str();
+}
+
+// Parses "TC:UNITS,TC:UNITS,..." with rising true counts
+bool parseBetRamp(const string& text, BetRamp& ramp, string& error) {
+    ramp.steps.clear();
+    istringstream list(text);
+    string step;
+    while (getline(list, step, ',')) {
+        size_t colon = step.find(':');
+        if (colon == string::npos) {
+            error = "ramp step '" + step + "' is not TC:UNITS";
+            return false;
+        }
+        int tc = atoi(step.substr(0, colon).c_str());
+        double units = atof(step.substr(colon + 1).c_str());
+        if (units <= 0.0) {
+            error = "ramp step '" + step + "' needs a positive bet";
+            return false;
+        }
+        if (!ramp.steps.empty() && tc <= ramp.steps.back().first) {
+            error = "ramp true counts must rise";
+            return false;
+        }
+        ramp.steps.emplace_back(tc, units);
+    }
+    if (ramp.steps.empty()) {
+        error = "empty bet ramp";
+        return false;
+    }
+    return true;
+}
+
+// A strategy deviation: play `action` instead of the chart when the
+// true count is at or above `index` (or below it, if !above).
+enum class DeviationHand : uint8_t { Hard, Pair };
+
+struct Deviation {
+    DeviationHand kind;
+    int  total;  // hard total, or the value of the paired card
+    int  up;     // dealer upcard, ace = 11
+    int  index;
+    bool above;
+    BasicAction action;
+};
+
+// The Illustrious 18 Hi-Lo indices for S17 shoe games, less insurance,
+// which the engine does not offer.
+constexpr Deviation kIllustrious18[] = {
+    { DeviationHand::Hard, 16, 10,  0, true,  BasicAction::Stand },
+    { DeviationHand::Hard, 15, 10,  4, true,  BasicAction::Stand },
+    { DeviationHand::Pair, 10,  5,  5, true,  BasicAction::Split },
+    { DeviationHand::Pair, 10,  6,  4, true,  BasicAction::Split },
+    { DeviationHand::Hard, 10, 10,  4, true,  BasicAction::DoubleDown },
+    { DeviationHand::Hard, 12,  3,  2, true,  BasicAction::Stand },
+    { DeviationHand::Hard, 12,  2,  3, true,  BasicAction::Stand },
+    { DeviationHand::Hard, 11, 11,  1, true,  BasicAction::DoubleDown },
+    { DeviationHand::Hard,  9,  2,  1, true,  BasicAction::DoubleDown },
+    { DeviationHand::Hard, 10, 11,  4, true,  BasicAction::DoubleDown },
+    { DeviationHand::Hard,  9,  7,  3, true,  BasicAction::DoubleDown },
+    { DeviationHand::Hard, 16,  9,  5, true,  BasicAction::Stand },
+    { DeviationHand::Hard, 13,  2, -1, false, BasicAction::Hit },
+    { DeviationHand::Hard, 12,  4,  0, false, BasicAction::Hit },
+    { DeviationHand::Hard, 12,  5, -2, false, BasicAction::Hit },
+    { DeviationHand::Hard, 12,  6, -1, false, BasicAction::Hit },
+    { DeviationHand::Hard, 13,  3, -2, false, BasicAction::Hit },
+};
+
+// Basic strategy for the rule set with the index plays layered on top.
+// Splits and surrenders from the chart stand; a deviation that is not
+// legal here (a double after the first decision) falls back to it.
+template <class Rules>
+BasicAction countingStrategyFor(const Hand& hand, int dealerUp,
+                                bool canDouble, bool canSplit,
+                                bool canSurrender, int trueCount,
+                                const StrategyChart* chart = nullptr) {
+    BasicAction base =
+        chart ? chartSuggestion(*chart, hand, dealerUp, canDouble, canSplit,
+                                canSurrender)
+              : basicStrategyFor<Rules>(hand, dealerUp, canDouble, canSplit,
+                                        canSurrender);
+    if (base == BasicAction::Surrender) return base;
+
+    bool pair = canSplit && isPair(hand);
+    for (const Deviation& d : kIllustrious18) {
+        if (d.up != dealerUp) continue;
+        if (d.kind == DeviationHand::Pair) {
+            if (!pair || cardValueForStrategy(hand.getCard(0)) != d.total) {
+                continue;
+            }
+        } else if (hand.isSoft() || hand.getValue() != d.total ||
+                   base == BasicAction::Split) {
+            continue;
+        }
+        if ((trueCount >= d.index) != d.above) continue;
+        if (d.action == BasicAction::DoubleDown && !canDouble) continue;
+        return d.action;
+    }
+    return base;
+}
+
+// Results by true count at the start of the round
+struct CountStats {
+    struct Bucket {
+        long long rounds = 0;
+        double net = 0.0, netSquared = 0.0, wagered = 0.0, bets = 0.0;
+    };
+    array<Bucket, 2 * kMaxTrueCount + 1> buckets{};
+
+    void record(int trueCount, double bet, const RoundOutcome& o) {
+        Bucket& b = buckets[static_cast<size_t>(trueCount + kMaxTrueCount)];
+        ++b.rounds;
+        b.net += o.net;
+        b.netSquared += o.net * o.net;
+        b.wagered += o.wagered;
+        b.bets += bet;
+    }
+
+    void merge(const CountStats& other) {
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            buckets[i].rounds += other.buckets[i].rounds;
+            buckets[i].net += other.buckets[i].net;
+            buckets[i].netSquared += other.buckets[i].netSquared;
+            buckets[i].wagered += other.buckets[i].wagered;
+            buckets[i].bets += other.buckets[i].bets;
+        }
+    }
+};
+
+// Risk of ruin for a bankroll of `units` with per-round mean `ev` and
+// variance `var`, by the diffusion approximation exp(-2 ev B / var).
+double riskOfRuin(double ev, double var, double units) {
+    if (ev <= 0.0 || var <= 0.0) return 1.0;
+    return exp(-2.0 * ev * units / var);
+}
+
+void printCountTable(const CountStats& stats, double bankrollUnits) {
+    long long total = 0;
+    CountStats::Bucket all;
+    for (const auto& b : stats.buckets) {
+        total += b.rounds;
+        all.rounds += b.rounds;
+        all.net += b.net;
+        all.netSquared += b.netSquared;
+        all.wagered += b.wagered;
+        all.bets += b.bets;
+    }
+    if (total == 0) return;
+
+    auto row = [&](const string& label, const CountStats::Bucket& b) {
+        double n = static_cast<double>(b.rounds);
+        double ev = b.net / n;
+        double var = max(b.netSquared / n - ev * ev, 0.0);
+        cout << setw(6) << label
+             << setw(12) << b.rounds
+             << setw(8) << 100.0 * n / static_cast<double>(total)
+             << setw(8) << b.bets / n
+             << setw(10) << ev
+             << setw(8) << sqrt(var)
+             << setw(9) << 100.0 * riskOfRuin(ev, var, bankrollUnits) << "\n";
+    };
+
+    cout << fixed << setprecision(3);
+    cout << "    TC      rounds  freq %     bet  EV/round      SD    RoR %\n";
+    for (size_t i = 0; i < stats.buckets.size(); ++i) {
+        if (stats.buckets[i].rounds == 0) continue;
+        int tc = static_cast<int>(i) - kMaxTrueCount;
+        string label = to_string(tc);
+        if (tc > 0) label = "+" + label;
+        if (tc == -kMaxTrueCount) label = "<=" + label;
+        if (tc == kMaxTrueCount) label = ">=" + label;
+        row(label, stats.buckets[i]);
+    }
+    row("all", all);
+    cout << defaultfloat << setprecision(6);
+    cout << "RoR is for a bankroll of " << bankrollUnits
+         << " units at that count's mean and variance\n";
+}
+
+// ---------------- Streaming statistics ------------------
+// Constant-memory accumulators filled one round at a time. Every one
+// merges with another of its kind, so workers keep their own and the
+// driver combines them; merging in a fixed order keeps runs reproducible.
+
+// Count, mean and sum of squared deviations (Welford), merged with
+// Chan et al.'s pairwise update
+struct RunningMoments {
+    long long n = 0;
+    double mean = 0.0;
+    double m2 = 0.0;
+
+    void add(double x) {
+        ++n;
+        double delta = x - mean;
+        mean += delta / static_cast<double>(n);
+        m2 += delta * (x - mean);
+    }
+
+    void merge(const RunningMoments& o) {
+        if (o.n == 0) return;
+        if (n == 0) { *this = o; return; }
+        double na = static_cast<double>(n), nb = static_cast<double>(o.n);
+        double delta = o.mean - mean;
+        double total = na + nb;
+        mean += delta * nb / total;
+        m2 += o.m2 + delta * delta * na * nb / total;
+        n += o.n;
+    }
+
+    double variance() const {
+        return n > 1 ? m2 / static_cast<double>(n - 1) : 0.0;
+    }
+    double stddev() const { return sqrt(variance()); }
+    // Half-width of the 95% confidence interval on the mean
+    double ci95() const {
+        return n > 1 ? 1.96 * stddev() / sqrt(static_cast<double>(n)) : 0.0;
+    }
+};
+
+// Hands and results for one (two-card total, dealer upcard) cell
+struct OutcomeCell {
+    long long hands = 0, wins = 0, pushes = 0, losses = 0;
+    double net = 0.0;  // in initial bets
+
+    void add(double result) {
+        ++hands;
+        net += result;
+        if (result > 0.0)      ++wins;
+        else if (result < 0.0) ++losses;
+        else                   ++pushes;
+    }
+
+    void merge(const OutcomeCell& o) {
+        hands += o.hands;
+        wins += o.wins;
+        pushes += o.pushes;
+        losses += o.losses;
+        net += o.net;
+    }
+};
+
+// Where the bankroll spends its time: after every round, the bankroll
+// relative to the start of the current session goes into a fixed-width
+// bin. Sessions restart every `sessionRounds` rounds.
+struct TrajectoryHistogram {
+    static constexpr int kBins = 64;
+
+    long long sessionRounds = 1000;
+    double    binWidth = 4.0;        // in initial bets
+    array<long long, kBins> bins{};
+    long long below = 0, above = 0;  // outside the binned range
+    double    lowest = 0.0, highest = 0.0;
+
+    // Position within the current session; not merged
+    long long played = 0;
+    double    position = 0.0;
+
+    void add(double net) {
+        if (played == sessionRounds) {
+            played = 0;
+            position = 0.0;
+        }
+        ++played;
+        position += net;
+        lowest = min(lowest, position);
+        highest = max(highest, position);
+        double slot = floor(position / binWidth) + kBins / 2;
+        if (slot < 0)          ++below;
+        else if (slot >= kBins) ++above;
+        else                   bins[static_cast<size_t>(slot)]++;
+    }
+
+    void merge(const TrajectoryHistogram& o) {
+        for (int i = 0; i < kBins; ++i) bins[i] += o.bins[i];
+        below += o.below;
+        above += o.above;
+        lowest = min(lowest, o.lowest);
+        highest = max(highest, o.highest);
+    }
+
+    double binStart(int i) const { return (i - kBins / 2) * binWidth; }
+};
+
+struct StreamingStats {
+    RunningMoments perRound;  // net per round, in initial bets
+    RunningMoments perHand;   // net per hand, in initial bets
+    long long rounds = 0, hands = 0;
+    long long wins = 0, pushes = 0, losses = 0;  // per round
+    long long blackjacks = 0, playerBusts = 0, dealerBusts = 0;
+    long long doubles = 0, splits = 0, surrenders = 0;
+    // [soft][two-card total][upcard - 2]
+    array<array<array<OutcomeCell, 10>, 22>, 2> matrix{};
+    TrajectoryHistogram trajectory;
+
+    template <int MaxHands>
+    void record(const RoundState<MaxHands>& st, const RoundOutcome& o,
+                double bet) {
+        double scale = 1.0 / bet;
+        ++rounds;
+        perRound.add(o.net * scale);
+        trajectory.add(o.net * scale);
+        if (o.net > 0.0)      ++wins;
+        else if (o.net < 0.0) ++losses;
+        else                  ++pushes;
+        if (o.playerBlackjack && !o.dealerBlackjack) ++blackjacks;
+        if (o.dealerBust) ++dealerBusts;
+        if (o.surrendered) ++surrenders;
+        for (size_t k = 0; k < min<size_t>(st.actionCount,
+                                           st.actions.size()); ++k) {
+            BasicAction a = static_cast<BasicAction>(st.actions[k] & 0x0f);
+            if (a == BasicAction::DoubleDown) ++doubles;
+            if (a == BasicAction::Split) ++splits;
+        }
+
+        int up = dealerUpValue(st.dealer);
+        for (size_t h = 0; h < st.size(); ++h) {
+            const Hand& hand = st.hands[h];
+            double result = st.handNet[h] * scale;
+            ++hands;
+            perHand.add(result);
+            if (hand.isBust()) ++playerBusts;
+
+            int a = cardValueForStrategy(hand.getCard(0));
+            int b = cardValueForStrategy(hand.getCard(1));
+            bool soft = a == 11 || b == 11;
+            int total = (a == 11 && b == 11) ? 12 : a + b;
+            matrix[soft][static_cast<size_t>(total)]
+                  [static_cast<size_t>(up - 2)].add(result);
+        }
+    }
+
+    void merge(const StreamingStats& o) {
+        perRound.merge(o.perRound);
+        perHand.merge(o.perHand);
+        rounds += o.rounds;
+        hands += o.hands;
+        wins += o.wins;
+        pushes += o.pushes;
+        losses += o.losses;
+        blackjacks += o.blackjacks;
+        playerBusts += o.playerBusts;
+        dealerBusts += o.dealerBusts;
+        doubles += o.doubles;
+        splits += o.splits;
+        surrenders += o.surrenders;
+        for (size_t s = 0; s < 2; ++s) {
+            for (size_t t = 0; t < 22; ++t) {
+                for (size_t u = 0; u < 10; ++u) {
+                    matrix[s][t][u].merge(o.matrix[s][t][u]);
+                }
+            }
+        }
+        trajectory.merge(o.trajectory);
+    }
+};
+
+// Rates, moments and the bankroll histogram, plus (if `withMatrix`) the
+// EV table by two-card total and upcard
+void printStreamingStats(ostream& out, const StreamingStats& s,
+                         bool withMatrix) {
+    if (s.rounds == 0) return;
+    double rounds = static_cast<double>(s.rounds);
+    double hands = static_cast<double>(max(s.hands, 1LL));
+    auto pct = [](long long part, double whole) {
+        return 100.0 * static_cast<double>(part) / whole;
+    };
+
+    out << fixed << setprecision(4);
+    out << "EV per round:    " << s.perRound.mean << " +/- "
+        << s.perRound.ci95() << " bets (SD " << s.perRound.stddev() << ")\n";
+    out << "EV per hand:     " << s.perHand.mean << " +/- "
+        << s.perHand.ci95() << " bets (SD " << s.perHand.stddev() << ")\n";
+    out << setprecision(2);
+    out << "Rounds won/push/lost: " << pct(s.wins, rounds) << "% / "
+        << pct(s.pushes, rounds) << "% / " << pct(s.losses, rounds) << "%\n";
+    out << "Blackjacks:      " << pct(s.blackjacks, rounds)
+        << "% of rounds\n";
+    out << "Player busts:    " << pct(s.playerBusts, hands) << "% of hands\n";
+    out << "Dealer busts:    " << pct(s.dealerBusts, rounds)
+        << "% of rounds\n";
+    out << "Doubles/splits/surrenders: " << pct(s.doubles, rounds) << "% / "
+        << pct(s.splits, rounds) << "% / " << pct(s.surrenders, rounds)
+        << "% of rounds\n";
+
+    const TrajectoryHistogram& t = s.trajectory;
+    if (t.sessionRounds == numeric_limits<long long>::max()) {
+        out << "\nBankroll over the session";
+    } else {
+        out << "\nBankroll within " << t.sessionRounds << "-round sessions";
+    }
+    out << " (range " << t.lowest << " to " << t.highest << " bets):\n";
+    long long samples = t.below + t.above;
+    long long peak = 1;
+    for (long long c : t.bins) {
+        samples += c;
+        peak = max(peak, c);
+    }
+    int first = 0, last = TrajectoryHistogram::kBins - 1;
+    while (first < last && t.bins[first] == 0) ++first;
+    while (last > first && t.bins[last] == 0) --last;
+    if (t.below) out << "  below " << t.binStart(0) << ": " << t.below << "\n";
+    for (int i = first; i <= last; ++i) {
+        size_t bar = static_cast<size_t>(40 * t.bins[i] / peak);
+        out << setw(8) << t.binStart(i) << " " << setw(6)
+            << pct(t.bins[i], static_cast<double>(samples)) << "%"
+            << (bar ? " " + string(bar, '#') : "") << "\n";
+    }
+    if (t.above) {
+        out << "  above " << t.binStart(TrajectoryHistogram::kBins) << ": "
+            << t.above << "\n";
+    }
+
+    if (withMatrix) {
+        out << setprecision(3);
+        out << "\nEV per hand by first two cards (rows) and upcard "
+               "(columns):\n      ";
+        for (int up = 2; up <= 11; ++up) {
+            out << setw(7) << cardValueToString(up);
+        }
+        out << "\n";
+        for (size_t soft = 0; soft < 2; ++soft) {
+            for (size_t total = 4; total < 22; ++total) {
+                const auto& row = s.matrix[soft][total];
+                bool any = false;
+                for (const auto& c : row) any |= c.hands > 0;
+                if (!any) continue;
+                out << (soft ? "soft " : "hard ") << setw(2) << total;
+                for (const auto& c : row) {
+                    if (c.hands == 0) {
+                        out << setw(7) << ".";
+                    } else {
+                        out << setw(7)
+                            << c.net / static_cast<double>(c.hands);
+                    }
+                }
+                out << "\n";
+            }
+        }
+    }
+    out << defaultfloat << setprecision(6);
+}
+
+// -------------------- Hand history ----------------------
+// Optional binary log of every round: a 64-byte file header followed by
+// fixed 128-byte records, both in host byte order, so a reader can map
+// the file and index records directly. Card values are stored as 2-10
+// and 11 for an ace; suits are not kept.
+constexpr char     kHistoryMagic[8] = { 'B', 'J', 'H', 'I', 'S', 'T', '1', 0 };
+constexpr uint32_t kHistoryVersion = 1;
+
+struct HandHistoryHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t seed;            // master seed of the run
+    uint8_t  decks;
+    uint8_t  hitSoft17;
+    uint8_t  doubleAfterSplit;
+    uint8_t  resplit;
+    uint8_t  lateSurrender;
+    uint8_t  sixToFive;
+    uint8_t  reserved0[2];
+    float    blackjackPays;
+    uint8_t  reserved[28];
+};
+static_assert(sizeof(HandHistoryHeader) == 64, "header is 64 bytes");
+
+// Record flags
+constexpr uint8_t kRecPlayerBlackjack = 1;
+constexpr uint8_t kRecDealerBlackjack = 2;
+constexpr uint8_t kRecSurrendered     = 4;
+constexpr uint8_t kRecTruncated       = 8;  // cards or actions did not fit
+
+struct HandRecord {
+    uint64_t seed;            // master seed
+    uint64_t round;           // round number within the stream
+    uint32_t stream;          // worker stream the shoe was seeded from
+    float    bet;             // initial bet
+    float    net;             // bankroll change for the round
+    uint8_t  hands;           // player hands at the end of the round
+    uint8_t  dealerCards;
+    uint8_t  flags;
+    uint8_t  doubled;         // bit h: hand h was doubled
+    uint8_t  handCards[4];
+    uint8_t  actionCount;
+    uint8_t  reserved[3];
+    uint8_t  actions[24];     // hand index << 4 | BasicAction, in order
+    uint8_t  cards[64];       // dealer's cards (hole card first), then
+                              // each hand's cards in hand order
+};
+static_assert(sizeof(HandRecord) == 128, "records are 128 bytes");
+
+HandHistoryHeader makeHistoryHeader(const RuleOptions& rules, uint64_t seed) {
+    HandHistoryHeader h{};
+    copy(begin(kHistoryMagic), end(kHistoryMagic), h.magic);
+    h.version = kHistoryVersion;
+    h.recordSize = sizeof(HandRecord);
+    h.seed = seed;
+    h.decks = static_cast<uint8_t>(rules.decks);
+    h.hitSoft17 = rules.hitSoft17;
+    h.doubleAfterSplit = rules.doubleAfterSplit;
+    h.resplit = rules.resplit;
+    h.lateSurrender = rules.lateSurrender;
+    h.sixToFive = rules.sixToFive;
+    h.blackjackPays = rules.sixToFive ? 1.2f : 1.5f;
+    return h;
+}
+
+// The output file, shared by every writer of a run. Writers hand it whole
+// blocks, so records never interleave below block granularity.
+class HandHistoryFile {
+private:
+    ofstream out;
+    mutex    lock;
+
+public:
+    bool open(const string& path, const HandHistoryHeader& header,
+              string& error) {
+        out.open(path, ios::binary | ios::trunc);
+        if (!out) {
+            error = "cannot write " + path;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        return static_cast<bool>(out);
+    }
+
+    void writeBlock(const char* data, size_t bytes) {
+        lock_guard<mutex> guard(lock);
+        out.write(data, static_cast<streamsize>(bytes));
+    }
+
+    // Flushes and closes the file; false if any write failed
+    bool close() {
+        out.close();
+        return !out.fail();
+    }
+};
+
+// Per-thread record builder with a 1 MiB buffer, flushed to the file
+// when full and on destruction.
+class HandHistoryWriter {
+private:
+    static constexpr size_t kBufferRecords = 8192;
+
+    HandHistoryFile* file;
+    vector<HandRecord> buffer;
+    uint64_t seed;
+    uint32_t stream;
+    uint64_t round = 0;
+
+public:
+    HandHistoryWriter(HandHistoryFile& f, uint64_t masterSeed,
+                      uint32_t streamId)
+        : file(&f), seed(masterSeed), stream(streamId) {
+        buffer.reserve(kBufferRecords);
+    }
+    HandHistoryWriter(const HandHistoryWriter&) = delete;
+    HandHistoryWriter& operator=(const HandHistoryWriter&) = delete;
+    ~HandHistoryWriter() { flush(); }
+
+    void flush() {
+        if (buffer.empty()) return;
+        file->writeBlock(reinterpret_cast<const char*>(buffer.data()),
+                         buffer.size() * sizeof(HandRecord));
+        buffer.clear();
+    }
+
+    template <int MaxHands>
+    void record(const RoundState<MaxHands>& st, const RoundOutcome& o,
+                double bet) {
+        static_assert(MaxHands <= 4, "records hold up to four hands");
+        HandRecord r{};
+        r.seed = seed;
+        r.round = round++;
+        r.stream = stream;
+        r.bet = static_cast<float>(bet);
+        r.net = static_cast<float>(o.net);
+        r.hands = static_cast<uint8_t>(st.size());
+        if (o.playerBlackjack) r.flags |= kRecPlayerBlackjack;
+        if (o.dealerBlackjack) r.flags |= kRecDealerBlackjack;
+        if (o.surrendered)     r.flags |= kRecSurrendered;
+
+        size_t used = 0;
+        auto put = [&r, &used](const Hand& hand) {
+            uint8_t n = 0;
+            for (const Card& c : hand) {
+                if (used == sizeof(r.cards)) {
+                    r.flags |= kRecTruncated;
+                    break;
+                }
+                r.cards[used++] = static_cast<uint8_t>(cardValueForStrategy(c));
+                n++;
+            }
+            return n;
+        };
+        r.dealerCards = put(st.dealer);
+        for (size_t h = 0; h < st.size(); ++h) {
+            r.handCards[h] = put(st.hands[h]);
+            if (st.bets[h] > bet) r.doubled |= static_cast<uint8_t>(1u << h);
+        }
+
+        r.actionCount = min<uint8_t>(st.actionCount, sizeof(r.actions));
+        if (st.actionCount > r.actionCount) r.flags |= kRecTruncated;
+        copy(st.actions.begin(), st.actions.begin() + r.actionCount,
+             r.actions);
+
+        buffer.push_back(r);
+        if (buffer.size() == kBufferRecords) flush();
+    }
+};
+
+// -------------------- Simulation mode -------------------
+// Totals for a batch of simulated rounds. Workers keep their own copy
+// and the driver merges them in worker order, so a run is reproducible
+// bit for bit for a given seed and thread count.
+struct SimStats {
+    long long rounds = 0;
+    long long wins = 0, pushes = 0, losses = 0, blackjacks = 0;
+    double net = 0.0, netSquared = 0.0, wagered = 0.0;
+    CountStats byCount;      // filled by counted runs only
+    StreamingStats detail;   // filled when detailed stats are on
+
+    void record(const RoundOutcome& o) {
+        ++rounds;
+        net += o.net;
+        netSquared += o.net * o.net;
+        wagered += o.wagered;
+        if (o.playerBlackjack && !o.dealerBlackjack) ++blackjacks;
+        if (o.net > 0.0)      ++wins;
+        else if (o.net < 0.0) ++losses;
+        else                  ++pushes;
+    }
+
+    void merge(const SimStats& other) {
+        rounds += other.rounds;
+        wins += other.wins;
+        pushes += other.pushes;
+        losses += other.losses;
+        blackjacks += other.blackjacks;
+        net += other.net;
+        netSquared += other.netSquared;
+        wagered += other.wagered;
+        byCount.merge(other.byCount);
+        detail.merge(other.detail);
+    }
+
+    // Half-width of the 95% confidence interval on net per round
+    double ci95() const {
+        if (rounds < 2) return 0.0;
+        double n = static_cast<double>(rounds);
+        double mean = net / n;
+        double var = max(netSquared / n - mean * mean, 0.0) * n / (n - 1.0);
+        return 1.96 * sqrt(var / n);
+    }
+};
+
+struct SimConfig {
+    long long rounds  = 0;
+    unsigned  threads = 1;
+    uint64_t  seed    = 0;
+    double    penetration = 0.75;  // fraction dealt before the cut card
+    int       csmTray = -1;        // CSM tray cards, -1 for a dealt shoe
+    RngKind   rng = RngKind::Xoshiro;
+    RuleOptions rules;
+
+    // Counted play, when `count` is set
+    const CountSystem* count = nullptr;
+    BetRamp ramp = defaultBetRamp();
+    bool    deviations = false;
+    double  bankrollUnits = 1000.0;  // for the risk-of-ruin column
+
+    string historyPath;  // hand-history file to write, if any
+    bool   detailedStats = false;  // fill SimStats::detail
+    int    seats = 1;              // players at the table, 1-7
+    const StrategyChart* chart = nullptr;  // else the rules' basic strategy
+
+    // Live telemetry, in builds with BLACKJACK_TELEMETRY
+    double telemetrySeconds = 0.0;  // report interval, 0 for totals only
+    string telemetryJson;           // snapshot file, if any
+
+    string checkpointPath;             // resume from and save to, if set
+    double checkpointSeconds = 60.0;   // between a worker's snapshots
+};
+
+// The simulate functions below add to `stats`, so a worker can play its
+// share in several calls (between checkpoints) with the same results.
+
+// Plays `rounds` flat-bet rounds with basic strategy and no console I/O,
+// logging each round to `history` if given.
+template <class Rules>
+void simulateRounds(Shoe& deck, long long rounds, SimStats& stats,
+                    const SimConfig& cfg,
+                    HandHistoryWriter* history = nullptr) {
+    RoundEngine<Rules> engine;
+    const double bankroll = numeric_limits<double>::infinity();
+    auto run = [&](auto&& decide) {
+        for (long long i = 0; i < rounds; ++i) {
+            RoundOutcome o = engine.play(deck, 1.0, bankroll, decide);
+            stats.record(o);
+            if (cfg.detailedStats) {
+                stats.detail.record(engine.roundState(), o, 1.0);
+            }
+            if (history) history->record(engine.roundState(), o, 1.0);
+        }
+    };
+    if (cfg.chart) {
+        const StrategyChart& chart = *cfg.chart;
+        run([&chart](const Hand& hand, int up, bool canDouble,
+                     bool canSplit, bool canSurrender) {
+            return chartSuggestion(chart, hand, up, canDouble, canSplit,
+                                   canSurrender);
+        });
+    } else {
+        run(basicStrategyFor<Rules>);
+    }
+}
+
+// Plays `rounds` rounds with the shoe counted: the bet follows the ramp
+// and, if enabled, decisions take the index plays at the live count.
+template <class Rules>
+void simulateCountedRounds(Shoe& deck, long long rounds, SimStats& stats,
+                           const SimConfig& cfg,
+                           HandHistoryWriter* history = nullptr) {
+    RoundEngine<Rules> engine;
+    const double bankroll = numeric_limits<double>::infinity();
+    auto decide = [&deck, &cfg](const Hand& hand, int up, bool canDouble,
+                                bool canSplit, bool canSurrender) {
+        if (!cfg.deviations) {
+            if (cfg.chart) {
+                return chartSuggestion(*cfg.chart, hand, up, canDouble,
+                                       canSplit, canSurrender);
+            }
+            return basicStrategyFor<Rules>(hand, up, canDouble,
+                                           canSplit, canSurrender);
+        }
+        return countingStrategyFor<Rules>(hand, up, canDouble, canSplit,
+                                          canSurrender,
+                                          trueCountBucket(deck.trueCount()),
+                                          cfg.chart);
+    };
+    for (long long i = 0; i < rounds; ++i) {
+        deck.prepareRound();  // so a due shuffle happens before the bet
+        int tc = trueCountBucket(deck.trueCount());
+        double bet = cfg.ramp.betFor(tc);
+        RoundOutcome o = engine.play(deck, bet, bankroll, decide);
+        stats.record(o);
+        stats.byCount.record(tc, bet, o);
+        if (cfg.detailedStats) {
+            stats.detail.record(engine.roundState(), o, bet);
+        }
+        if (history) history->record(engine.roundState(), o, bet);
+    }
+}
+
+// Plays `rounds` rounds at a table of cfg.seats seats, all on basic
+// strategy. Stats count seat-rounds. With a count system, every seat
+// bets the ramp on the true count at the start of the round.
+template <class Rules>
+void simulateTableRounds(Shoe& deck, long long rounds, SimStats& stats,
+                         const SimConfig& cfg,
+                         HandHistoryWriter* history = nullptr) {
+    TableEngine<Rules> table;
+    for (int i = 0; i < cfg.seats; ++i) table.addSeat({});
+    for (long long r = 0; r < rounds; ++r) {
+        int tc = 0;
+        if (cfg.count) {
+            deck.prepareRound();
+            tc = trueCountBucket(deck.trueCount());
+            for (size_t i = 0; i < table.size(); ++i) {
+                table.seat(i).bet = cfg.ramp.betFor(tc);
+            }
+        }
+        table.playRound(deck);
+        for (size_t i = 0; i < table.size(); ++i) {
+            const RoundOutcome& o = table.outcome(i);
+            double bet = table.seat(i).bet;
+            const auto& st = table.seatEngine(i).roundState();
+            stats.record(o);
+            if (cfg.count) stats.byCount.record(tc, bet, o);
+            if (cfg.detailedStats) stats.detail.record(st, o, bet);
+            if (history) history->record(st, o, bet);
+        }
+    }
+}
+
+// Checkpoints for long runs. Workers are independent, so a checkpoint
+// holds each worker's latest state: the rounds it has played of its
+// share, its SimStats, and its shoe with the generator inside. A resumed
+// run puts every worker back where it was and ends with the same numbers,
+// bit for bit, as a run that never stopped. Workers hand over a copy of
+// their state between chunks of rounds; a writer thread does the file
+// I/O, so a worker never waits on the disk.
+//
+// File: the CheckpointHeader, the settings key, then for each worker a
+// 64-bit length and its state, then an FNV-1a checksum of all of that.
+constexpr long long kCheckpointChunk = 1 << 16;  // rounds between clock checks
+
+struct CheckpointHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t workers;
+    uint64_t keyBytes;
+};
+static_assert(sizeof(CheckpointHeader) == 24, "checkpoint header layout");
+
+constexpr char kCheckpointMagic[8] = { 'B', 'J', 'C', 'K', 'P', 'T', '1', 0 };
+constexpr uint32_t kCheckpointVersion = 2;
+
+uint64_t fnv1a(const char* p, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < n; ++i) {
+        h = (h ^ static_cast<unsigned char>(p[i])) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// Every setting that changes the rounds a worker plays. A checkpoint only
+// resumes a run whose key matches.
+string checkpointKey(const SimConfig& cfg) {
+    ostringstream key;
+    key << setprecision(17) << "rounds " << cfg.rounds
+        << "; threads " << max(1u, cfg.threads) << "; seed " << cfg.seed
+        << "; rng " << rngName(cfg.rng)
+        << "; penetration " << cfg.penetration << "; csm " << cfg.csmTray
+        << "; rules " << describeRules(cfg.rules)
+        << "; seats " << cfg.seats
+        << "; count " << (cfg.count ? cfg.count->name : "none")
+        << "; ramp " << describeRamp(cfg.ramp)
+        << "; deviations " << cfg.deviations
+        << "; stats " << cfg.detailedStats
+        << "; layout " << sizeof(SimStats) << "; chart ";
+    if (activeChartLoaded) {
+        key << hex << fnv1a(reinterpret_cast<const char*>(&activeChart),
+                            sizeof activeChart);
+    } else {
+        key << "default";
+    }
+    return key.str();
+}
+
+// A worker's state: rounds played of its share, stats, shoe
+string saveWorkerState(long long done, const SimStats& stats,
+                       const Shoe& shoe) {
+    string state;
+    putBytes(state, static_cast<int64_t>(done));
+    putBytes(state, stats);
+    shoe.save(state);
+    return state;
+}
+
+bool restoreWorkerState(const string& state, long long& done,
+                        SimStats& stats, Shoe& shoe) {
+    const char* p = state.data();
+    const char* end = p + state.size();
+    int64_t played = 0;
+    if (!getBytes(p, end, played) || !getBytes(p, end, stats) ||
+        !shoe.restore(p, end) || p != end) {
+        return false;
+    }
+    done = played;
+    return true;
+}
+
+class Checkpointer {
+private:
+    string path;
+    string key;
+    vector<string> latest;  // each worker's last state, empty if none
+    mutex lock;
+    condition_variable wake;
+    bool dirty = false;
+    bool done = false;
+    bool failed = false;
+    thread writer;
+
+    // Written aside, synced and renamed over the old file, so a crash at
+    // any point leaves either the old checkpoint or the new one
+    bool writeFile(const vector<string>& states) const {
+        string file;
+        CheckpointHeader h{};
+        memcpy(h.magic, kCheckpointMagic, sizeof h.magic);
+        h.version = kCheckpointVersion;
+        h.workers = static_cast<uint32_t>(states.size());
+        h.keyBytes = key.size();
+        putBytes(file, h);
+        file += key;
+        for (const string& s : states) {
+            putBytes(file, static_cast<uint64_t>(s.size()));
+            file += s;
+        }
+        putBytes(file, fnv1a(file.data(), file.size()));
+
+        string tmp = path + ".tmp";
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        size_t off = 0;
+        while (off < file.size()) {
+            ssize_t n = ::write(fd, file.data() + off, file.size() - off);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            off += static_cast<size_t>(n);
+        }
+        bool ok = off == file.size() && ::fsync(fd) == 0;
+        ok = ::close(fd) == 0 && ok;
+        return ok && ::rename(tmp.c_str(), path.c_str()) == 0;
+    }
+
+    void run() {
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [this] { return dirty || done; });
+            if (!dirty) return;
+            vector<string> states = latest;
+            dirty = false;
+            guard.unlock();
+            bool ok = writeFile(states);
+            guard.lock();
+            if (!ok && !failed) {
+                failed = true;
+                cerr << "cannot write checkpoint " << path << ": "
+                     << strerror(errno) << "\n";
+            }
+        }
+    }
+
+public:
+    double    every;                // seconds between a worker's offers
+    long long resumedRounds = 0;    // rounds in the restored SimStats
+    vector<string> resumed;         // states loaded from the file
+
+    Checkpointer(const string& file, const SimConfig& cfg, double interval)
+        : path(file), key(checkpointKey(cfg)),
+          latest(max(1u, cfg.threads)), every(interval) {}
+
+    ~Checkpointer() { finish(); }
+
+    // Reads the checkpoint if there is one. A missing file is a fresh
+    // start; a file that does not match this run is an error.
+    bool load(string& error) {
+        ifstream in(path, ios::binary);
+        if (!in) return true;
+        string file((istreambuf_iterator<char>(in)),
+                    istreambuf_iterator<char>());
+        const char* p = file.data();
+        const char* end = p + file.size();
+        CheckpointHeader h{};
+        uint64_t sum = 0;
+        if (file.size() < sizeof h + sizeof sum ||
+            !getBytes(p, end, h) ||
+            memcmp(h.magic, kCheckpointMagic, sizeof h.magic) != 0 ||
+            h.version != kCheckpointVersion) {
+            error = path + ": not a checkpoint";
+            return false;
+        }
+        memcpy(&sum, end - sizeof sum, sizeof sum);
+        end -= sizeof sum;
+        if (fnv1a(file.data(), file.size() - sizeof sum) != sum) {
+            error = path + ": checkpoint is damaged";
+            return false;
+        }
+        if (h.keyBytes > static_cast<size_t>(end - p) ||
+            string(p, h.keyBytes) != key || h.workers != latest.size()) {
+            error = path + ": checkpoint is for another run (" +
+                    string(p, min<size_t>(h.keyBytes, end - p)) + ")";
+            return false;
+        }
+        p += h.keyBytes;
+        resumed.assign(h.workers, string());
+        for (string& s : resumed) {
+            uint64_t n = 0;
+            if (!getBytes(p, end, n) || n > static_cast<size_t>(end - p)) {
+                error = path + ": checkpoint is damaged";
+                return false;
+            }
+            s.assign(p, n);
+            p += n;
+        }
+        latest = resumed;
+        return true;
+    }
+
+    void start() { writer = thread([this] { run(); }); }
+
+    void offer(unsigned w, string state) {
+        {
+            lock_guard<mutex> guard(lock);
+            latest[w] = move(state);
+            dirty = true;
+        }
+        wake.notify_one();
+    }
+
+    // Writes the last states offered and stops the writer
+    bool finish() {
+        {
+            lock_guard<mutex> guard(lock);
+            done = true;
+        }
+        wake.notify_one();
+        if (writer.joinable()) writer.join();
+        return !failed;
+    }
+};
+
+// Splits the run over `threads` workers. Worker w owns a shoe seeded
+// from stream w of the master seed and plays a fixed share of rounds.
+// With a checkpoint, each worker first takes back its saved state, then
+// plays in chunks and offers its state every `checkpoint->every` seconds
+// and once more at the end. Returns false if a saved state is unusable.
+template <class Rules>
+bool runParallelSimulation(const SimConfig& cfg, SimStats& total,
+                           HandHistoryFile* historyFile = nullptr,
+                           Checkpointer* checkpoint = nullptr) {
+    unsigned threads = max(1u, cfg.threads);
+    vector<SimStats> partial(threads);
+    vector<long long> done(threads, 0);
+    vector<unique_ptr<Shoe>> shoes(threads);
+    for (unsigned w = 0; w < threads; ++w) {
+        shoes[w] = makeShoe(cfg.rng, Rules::decks, cfg.penetration,
+                            cfg.seed, w);
+        if (cfg.csmTray >= 0) shoes[w]->useContinuousShuffler(cfg.csmTray);
+        if (cfg.count) shoes[w]->setCountSystem(cfg.count);
+        if (checkpoint && !checkpoint->resumed.empty() &&
+            !restoreWorkerState(checkpoint->resumed[w], done[w],
+                                partial[w], *shoes[w])) {
+            cerr << "checkpoint state for worker " << w << " is damaged\n";
+            return false;
+        }
+        if (checkpoint) checkpoint->resumedRounds += partial[w].rounds;
+    }
+
+    vector<thread> workers;
+    workers.reserve(threads);
+    for (unsigned w = 0; w < threads; ++w) {
+        long long share = cfg.rounds / threads
+                        + (w < cfg.rounds % threads ? 1 : 0);
+        workers.emplace_back([&, w, share] {
+            Shoe& shoe = *shoes[w];
+            SimStats& stats = partial[w];
+            unique_ptr<HandHistoryWriter> history;
+            if (historyFile) {
+                history = make_unique<HandHistoryWriter>(*historyFile,
+                                                         cfg.seed, w);
+            }
+            auto lastOffer = chrono::steady_clock::now();
+            while (done[w] < share) {
+                long long n = checkpoint
+                                  ? min(kCheckpointChunk, share - done[w])
+                                  : share - done[w];
+                if (cfg.seats > 1) {
+                    simulateTableRounds<Rules>(shoe, n, stats, cfg,
+                                               history.get());
+                } else if (cfg.count) {
+                    simulateCountedRounds<Rules>(shoe, n, stats, cfg,
+                                                 history.get());
+                } else {
+                    simulateRounds<Rules>(shoe, n, stats, cfg,
+                                          history.get());
+                }
+                done[w] += n;
+                if (!checkpoint) continue;
+                auto now = chrono::steady_clock::now();
+                chrono::duration<double> since = now - lastOffer;
+                if (since.count() >= checkpoint->every || done[w] == share) {
+                    checkpoint->offer(w, saveWorkerState(done[w], stats,
+                                                         shoe));
+                    lastOffer = now;
+                }
+            }
+        });
+    }
+
+    for (unsigned w = 0; w < threads; ++w) {
+        workers[w].join();
+        total.merge(partial[w]);
+    }
+    return true;
+}
+
+#ifdef BLACKJACK_TELEMETRY
+// TSC ticks per second, measured once against the steady clock
+double ticksPerSecond() {
+    static const double rate = [] {
+        auto t0 = chrono::steady_clock::now();
+        uint64_t c0 = readTicks();
+        this_thread::sleep_for(chrono::milliseconds(20));
+        uint64_t c1 = readTicks();
+        chrono::duration<double> dt = chrono::steady_clock::now() - t0;
+        return static_cast<double>(c1 - c0) / dt.count();
+    }();
+    return rate;
+}
+
+void printTelemetry(ostream& out, const TelemetrySnapshot& d, double seconds,
+                    const string& label) {
+    double perTick = 1e9 / ticksPerSecond();
+    double secs = max(seconds, 1e-9);
+    // Estimated ticks per phase: the timed mean over every call
+    double allTicks = 0.0;
+    for (int p = 0; p < kPhases; ++p) {
+        allTicks += d.meanTicks(p) * static_cast<double>(d.calls[p]);
+    }
+
+    out << label << ": " << static_cast<long long>(
+               static_cast<double>(d.counters[0]) / secs)
+        << " hands/s over " << seconds << " s\n";
+    out << "  phase      calls/s    mean ns   p50 ns   p99 ns   share\n";
+    for (int p = 0; p < kPhases; ++p) {
+        double calls = static_cast<double>(d.calls[p]);
+        double mean = d.meanTicks(p) * perTick;
+        out << "  " << left << setw(9) << kPhaseNames[p] << right
+            << setw(10) << static_cast<long long>(calls / secs)
+            << setw(11) << fixed << setprecision(1) << mean
+            << setw(9) << static_cast<long long>(
+                   static_cast<double>(d.quantileTicks(p, 0.50)) * perTick)
+            << setw(9) << static_cast<long long>(
+                   static_cast<double>(d.quantileTicks(p, 0.99)) * perTick)
+            << setw(7) << setprecision(1)
+            << 100.0 * d.meanTicks(p) * calls / max(allTicks, 1.0)
+            << "%" << defaultfloat << setprecision(6) << "\n";
+    }
+    out << "  per second:";
+    for (int c = 1; c < kCounters; ++c) {
+        out << " " << kCounterNames[c] << " "
+            << static_cast<long long>(static_cast<double>(d.counters[c]) /
+                                      secs);
+    }
+    out << "\n";
+}
+
+// Phase "ticks" and "histogram" cover the "timed" calls only. Histogram
+// bucket b counts times below 2^b ticks.
+void writeTelemetryJson(ostream& out, const TelemetrySnapshot& d,
+                        double seconds) {
+    out << "{\n  \"elapsed_s\": " << seconds
+        << ",\n  \"ticks_per_second\": " << ticksPerSecond()
+        << ",\n  \"hands_per_second\": "
+        << static_cast<double>(d.counters[0]) / max(seconds, 1e-9)
+        << ",\n  \"counters\": {";
+    for (int c = 0; c < kCounters; ++c) {
+        out << (c ? ", " : "") << "\"" << kCounterNames[c] << "\": "
+            << d.counters[c];
+    }
+    out << "},\n  \"phases\": [\n";
+    for (int p = 0; p < kPhases; ++p) {
+        out << "    {\"name\": \"" << kPhaseNames[p] << "\", "
+            << "\"calls\": " << d.calls[p] << ", "
+            << "\"timed\": " << d.timed[p] << ", "
+            << "\"ticks\": " << d.ticks[p] << ", \"histogram\": [";
+        int last = kTickBuckets - 1;
+        while (last > 0 && d.histogram[p][last] == 0) --last;
+        for (int b = 0; b <= last; ++b) {
+            out << (b ? ", " : "") << d.histogram[p][b];
+        }
+        out << "]}" << (p + 1 < kPhases ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+// Prints the last interval's rates to stderr every `seconds` while a
+// run goes on and, if `jsonPath` is set, replaces that file with the
+// totals so far. The file is written aside and renamed, so a reader
+// never sees half a snapshot. The totals for the whole run are printed
+// when the reporter is destroyed.
+class TelemetryReporter {
+private:
+    double seconds;
+    string jsonPath;
+    TelemetrySnapshot first, last;
+    mutex lock;
+    condition_variable wake;
+    bool done = false;
+    thread worker;
+
+    void exportJson(const TelemetrySnapshot& now) {
+        if (jsonPath.empty()) return;
+        string tmp = jsonPath + ".tmp";
+        {
+            ofstream out(tmp);
+            chrono::duration<double> dt = now.at - first.at;
+            writeTelemetryJson(out, now.since(first), dt.count());
+            if (!out) return;
+        }
+        rename(tmp.c_str(), jsonPath.c_str());
+    }
+
+    void run() {
+        unique_lock<mutex> guard(lock);
+        auto period = chrono::duration<double>(seconds);
+        while (!wake.wait_for(guard, period, [this] { return done; })) {
+            TelemetrySnapshot now = Telemetry::instance().snapshot();
+            chrono::duration<double> dt = now.at - last.at;
+            chrono::duration<double> total = now.at - first.at;
+            ostringstream label;
+            label << "telemetry at " << fixed << setprecision(1)
+                  << total.count() << " s";
+            printTelemetry(cerr, now.since(last), dt.count(), label.str());
+            exportJson(now);
+            last = now;
+        }
+    }
+
+public:
+    TelemetryReporter(double interval, const string& json)
+        : seconds(interval), jsonPath(json) {
+        ticksPerSecond();  // calibrate before the clock starts
+        first = last = Telemetry::instance().snapshot();
+        if (seconds > 0.0) worker = thread([this] { run(); });
+    }
+
+    ~TelemetryReporter() {
+        {
+            lock_guard<mutex> guard(lock);
+            done = true;
+        }
+        wake.notify_all();
+        if (worker.joinable()) worker.join();
+        TelemetrySnapshot now = Telemetry::instance().snapshot();
+        chrono::duration<double> dt = now.at - first.at;
+        printTelemetry(cerr, now.since(first), dt.count(), "telemetry total");
+        exportJson(now);
+    }
+};
+#endif
+
+bool runSimulation(const SimConfig& cfg) {
+    HandHistoryFile historyFile;
+    if (!cfg.historyPath.empty()) {
+        string error;
+        if (!historyFile.open(cfg.historyPath,
+                              makeHistoryHeader(cfg.rules, cfg.seed), error)) {
+            cerr << error << "\n";
+            return false;
+        }
+    }
+
+    unique_ptr<Checkpointer> checkpoint;
+    if (!cfg.checkpointPath.empty()) {
+        string error;
+        checkpoint = make_unique<Checkpointer>(cfg.checkpointPath, cfg,
+                                               cfg.checkpointSeconds);
+        if (!checkpoint->load(error)) {
+            cerr << error << "\n";
+            return false;
+        }
+        checkpoint->start();
+    }
+
+#ifdef BLACKJACK_TELEMETRY
+    unique_ptr<TelemetryReporter> reporter;
+    if (cfg.telemetrySeconds > 0.0 || !cfg.telemetryJson.empty()) {
+        reporter = make_unique<TelemetryReporter>(cfg.telemetrySeconds,
+                                                  cfg.telemetryJson);
+    }
+#endif
+    auto start = chrono::steady_clock::now();
+    SimStats s;
+    bool ran = false;
+    withRuleSet(cfg.rules, [&](auto rules) {
+        ran = runParallelSimulation<decltype(rules)>(
+            cfg, s, cfg.historyPath.empty() ? nullptr : &historyFile,
+            checkpoint.get());
+    });
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+#ifdef BLACKJACK_TELEMETRY
+    reporter.reset();
+#endif
+    if (!ran) return false;
+    if (checkpoint && !checkpoint->finish()) return false;
+    if (!cfg.historyPath.empty() && !historyFile.close()) {
+        cerr << "error writing " << cfg.historyPath << "\n";
+        return false;
+    }
+
+    double n = static_cast<double>(s.rounds > 0 ? s.rounds : 1);
+    cout << "Seed / threads:  " << cfg.seed << " / " << cfg.threads << "\n";
+    cout << "Generator:       " << rngName(cfg.rng) << "\n";
+    cout << "Rules:           " << describeRules(cfg.rules) << "\n";
+    if (cfg.csmTray == 0)
+        cout << "Shuffler:        continuous, ideal\n";
+    else if (cfg.csmTray > 0)
+        cout << "Shuffler:        continuous, " << cfg.csmTray
+             << "-card tray\n";
+    else
+        cout << "Penetration:     " << 100.0 * cfg.penetration << "%\n";
+    if (cfg.seats > 1) {
+        cout << "Table:           " << cfg.seats << " seats, "
+             << cfg.rounds << " rounds dealt\n";
+        cout << "Seat-rounds:     " << s.rounds << "\n";
+    } else {
+        cout << "Rounds played:   " << s.rounds << "\n";
+    }
+    cout << "Net result:      " << s.net << " units\n";
+    cout << "Total wagered:   " << s.wagered << " units\n";
+    cout << "EV per round:    " << 100.0 * s.net / n << "% of base bet\n";
+    cout << "Won/Push/Lost:   " << s.wins << " / " << s.pushes
+         << " / " << s.losses << "\n";
+    cout << "Blackjacks:      " << s.blackjacks << "\n";
+    long long resumed = checkpoint ? checkpoint->resumedRounds : 0;
+    if (resumed > 0) {
+        cout << "Resumed:         " << resumed << " rounds from "
+             << cfg.checkpointPath << "\n";
+    }
+    cout << "Elapsed:         " << elapsed.count() << " s ("
+         << static_cast<long long>(static_cast<double>(s.rounds - resumed) /
+                                   max(elapsed.count(), 1e-9))
+         << " rounds/s)\n";
+
+    if (cfg.count) {
+        cout << "\nCount system:    " << cfg.count->name
+             << (cfg.deviations ? " with Illustrious 18 deviations" : "")
+             << "\n";
+        cout << "Bet ramp:        " << describeRamp(cfg.ramp) << " units\n";
+        cout << "EV per wagered:  "
+             << 100.0 * s.net / max(s.wagered, 1e-9) << "%\n\n";
+        printCountTable(s.byCount, cfg.bankrollUnits);
+    }
+    if (cfg.detailedStats) {
+        cout << "\n";
+        printStreamingStats(cout, s.detail, true);
+    }
+    return true;
+}
+
+// ----------------- Strategy comparison ------------------
+// Two charts played on common random numbers. Each round is dealt once
+// from the worker's shoe: the baseline plays it there, and the candidate
+// replays it from a copy of the same shoe state. The luck of the cards
+// then cancels in the paired difference, and most rounds differ by
+// exactly zero. With antithetic pairs, both strategies also replay the
+// round with the player's and dealer's first two cards swapped, and the
+// two differences are averaged into one sample.
+struct CompareStats {
+    RunningMoments baseline, candidate;  // net per round played
+    RunningMoments diff;                 // candidate - baseline per sample
+    long long differing = 0;             // samples with a nonzero diff
+
+    void merge(const CompareStats& o) {
+        baseline.merge(o.baseline);
+        candidate.merge(o.candidate);
+        diff.merge(o.diff);
+        differing += o.differing;
+    }
+};
+
+template <class Rules>
+CompareStats compareRounds(Shoe& shoe, Shoe& start, Shoe& twin,
+                           long long samples, const StrategyChart& base,
+                           const StrategyChart& cand, bool antithetic) {
+    RoundEngine<Rules> engine;
+    CompareStats stats;
+    const double bankroll = numeric_limits<double>::infinity();
+    auto play = [&engine, bankroll](Shoe& s, const StrategyChart& chart) {
+        auto decide = [&chart](const Hand& hand, int up, bool canDouble,
+                               bool canSplit, bool canSurrender) {
+            return chartSuggestion(chart, hand, up, canDouble, canSplit,
+                                   canSurrender);
+        };
+        return engine.play(s, 1.0, bankroll, decide).net;
+    };
+    auto replay = [&](const StrategyChart& chart, bool swapped) {
+        twin.copyDealFrom(start);
+        if (swapped) twin.swapInitialDeal();
+        return play(twin, chart);
+    };
+
+    for (long long i = 0; i < samples; ++i) {
+        shoe.prepareRound();  // so the copy is taken after any shuffle
+        start.copyDealFrom(shoe);
+        double a = play(shoe, base);
+        double b = replay(cand, false);
+        stats.baseline.add(a);
+        stats.candidate.add(b);
+        double d = b - a;
+        if (antithetic) {
+            double a2 = replay(base, true);
+            double b2 = replay(cand, true);
+            stats.baseline.add(a2);
+            stats.candidate.add(b2);
+            d = 0.5 * (d + b2 - a2);
+        }
+        stats.diff.add(d);
+        if (d != 0.0) ++stats.differing;
+    }
+    return stats;
+}
+
+// Worker w deals from stream w of the master seed, as a plain
+// simulation does, so the baseline numbers match --simulate.
+template <class Rules>
+CompareStats runParallelComparison(const SimConfig& cfg,
+                                   const StrategyChart& base,
+                                   const StrategyChart& cand,
+                                   bool antithetic) {
+    unsigned threads = max(1u, cfg.threads);
+    vector<CompareStats> partial(threads);
+    vector<thread> workers;
+    workers.reserve(threads);
+
+    for (unsigned w = 0; w < threads; ++w) {
+        long long share = cfg.rounds / threads
+                        + (w < cfg.rounds % threads ? 1 : 0);
+        workers.emplace_back([&, w, share] {
+            auto shoe = makeShoe(cfg.rng, Rules::decks, cfg.penetration,
+                                 cfg.seed, w);
+            if (cfg.csmTray >= 0) shoe->useContinuousShuffler(cfg.csmTray);
+            // Replay shoes only draw from their own generators when a
+            // round runs the shoe dry
+            auto start = makeShoe(cfg.rng, Rules::decks, cfg.penetration,
+                                  cfg.seed, threads + w);
+            auto twin = makeShoe(cfg.rng, Rules::decks, cfg.penetration,
+                                 cfg.seed, threads + w);
+            partial[w] = compareRounds<Rules>(*shoe, *start, *twin, share,
+                                              base, cand, antithetic);
+        });
+    }
+
+    CompareStats total;
+    for (unsigned w = 0; w < threads; ++w) {
+        workers[w].join();
+        total.merge(partial[w]);
+    }
+    return total;
+}
+
+int chartCellsDiffering(const StrategyChart& a, const StrategyChart& b) {
+    int n = 0;
+    for (size_t r = 0; r < a.hard.size(); ++r) {
+        for (int c = 0; c < StrategyChart::kCols; ++c) {
+            n += a.hard[r][c] != b.hard[r][c];
+            n += a.soft[r][c] != b.soft[r][c];
+            if (r < a.pair.size()) n += a.pair[r][c] != b.pair[r][c];
+        }
+    }
+    return n;
+}
+
+void runComparison(const SimConfig& cfg, const StrategyChart& base,
+                   const StrategyChart& cand, const string& candidateName,
+                   bool antithetic) {
+    auto start = chrono::steady_clock::now();
+    CompareStats s;
+    withRuleSet(cfg.rules, [&](auto rules) {
+        s = runParallelComparison<decltype(rules)>(cfg, base, cand,
+                                                   antithetic);
+    });
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    // Separate runs of the same size would see both variances in full
+    double perStrategy = static_cast<double>(s.baseline.n);
+    double independent =
+        perStrategy > 0.0
+            ? 1.96 * sqrt((s.baseline.variance() + s.candidate.variance()) /
+                          perStrategy)
+            : 0.0;
+    double paired = s.diff.ci95();
+    double factor = paired > 0.0 ? (independent * independent) /
+                                       (paired * paired)
+                                 : 0.0;
+
+    cout << "Seed / threads:  " << cfg.seed << " / " << cfg.threads << "\n";
+    cout << "Generator:       " << rngName(cfg.rng) << "\n";
+    cout << "Rules:           " << describeRules(cfg.rules) << "\n";
+    cout << "Candidate:       " << candidateName << " ("
+         << chartCellsDiffering(base, cand) << " cells differ)\n";
+    cout << "Samples:         " << s.diff.n << " paired"
+         << (antithetic ? ", antithetic" : "") << " ("
+         << s.baseline.n << " rounds per strategy)\n";
+    cout << "Baseline EV:     " << 100.0 * s.baseline.mean << "% +/- "
+         << 100.0 * s.baseline.ci95() << "\n";
+    cout << "Candidate EV:    " << 100.0 * s.candidate.mean << "% +/- "
+         << 100.0 * s.candidate.ci95() << "\n";
+    cout << "Difference:      " << 100.0 * s.diff.mean << "% +/- "
+         << 100.0 * paired << " (paired, 95%)\n";
+    cout << "Separate runs:   +/- " << 100.0 * independent
+         << " for the same rounds\n";
+    if (factor > 0.0) {
+        cout << "Variance factor: " << factor << "x (separate runs need ~"
+             << static_cast<long long>(perStrategy * factor)
+             << " rounds per strategy)\n";
+    }
+    cout << "Samples changed: "
+         << 100.0 * static_cast<double>(s.differing) /
+                static_cast<double>(max(s.diff.n, 1LL))
+         << "%\n";
+    cout << "Elapsed:         " << elapsed.count() << " s\n";
+}
+
+// -------------------- Parameter sweep -------------------
+// A sweep file lists one setting per line with the values to try:
+//     decks    1 2 6
+//     h17      0 1
+//     payout   3:2 6:5
+//     chart    default soft18.txt
+//     count    hilo
+//     ramp     2:2,3:4 2:4,3:8,4:12
+// Every combination of values is a cell; settings that are not listed
+// keep their command-line values. A chart file is read over the cell's
+// default chart, as with --compare.
+//
+// Each cell is played in batches of a fixed number of rounds, each batch
+// from its own shoe seeded from the cell and batch numbers. A cell runs
+// until --simulate N rounds or, with a target, until its 95% interval on
+// net per round is that narrow. Batches from every cell share one
+// work-stealing pool. A cell merges its batches in batch order and checks
+// the target after each one, so its result does not depend on the
+// scheduling. Batches that finish after their cell has stopped are
+// dropped.
+struct SweepCell {
+    using RunBatch = void (*)(const SimConfig&, uint64_t, long long,
+                              SimStats&);
+
+    SimConfig     cfg;
+    string        label;      // the swept settings, e.g. "decks=6 h17=1"
+    string        chartPath;  // empty for the default chart
+    StrategyChart chart;      // cfg.chart points here when loaded
+    RunBatch      runBatch = nullptr;
+    long long     maxBatches = 0;
+
+    mutex lock;
+    SimStats merged;
+    long long mergedBatches = 0;
+    map<long long, SimStats> waiting;  // finished ahead of their turn
+    atomic<bool> done{false};
+    bool reachedTarget = false;
+};
+
+template <class Rules>
+void runSweepBatch(const SimConfig& cfg, uint64_t seed, long long rounds,
+                   SimStats& stats) {
+    unique_ptr<Shoe> shoe = makeShoe(cfg.rng, Rules::decks, cfg.penetration,
+                                     seed, 0);
+    if (cfg.csmTray >= 0) shoe->useContinuousShuffler(cfg.csmTray);
+    if (cfg.count) {
+        shoe->setCountSystem(cfg.count);
+        simulateCountedRounds<Rules>(*shoe, rounds, stats, cfg);
+    } else {
+        simulateRounds<Rules>(*shoe, rounds, stats, cfg);
+    }
+}
+
+bool applySweepSetting(const string& name, const string& value,
+                       SweepCell& cell, string& error) {
+    SimConfig& cfg = cell.cfg;
+    auto flag = [&value, &error](bool& target) {
+        if (value != "0" && value != "1") {
+            error = "expected 0 or 1, got '" + value + "'";
+            return false;
+        }
+        target = value == "1";
+        return true;
+    };
+    if (name == "decks") {
+        cfg.rules.decks = atoi(value.c_str());
+        if (!supportedDeckCount(cfg.rules.decks)) {
+            error = "decks must be 1, 2, 4, 6 or 8";
+            return false;
+        }
+    } else if (name == "penetration") {
+        cfg.penetration = atof(value.c_str());
+        if (cfg.penetration <= 0.0 || cfg.penetration > 1.0) {
+            error = "penetration must be in (0, 1]";
+            return false;
+        }
+    } else if (name == "h17") {
+        return flag(cfg.rules.hitSoft17);
+    } else if (name == "das") {
+        return flag(cfg.rules.doubleAfterSplit);
+    } else if (name == "resplit") {
+        return flag(cfg.rules.resplit);
+    } else if (name == "surrender") {
+        return flag(cfg.rules.lateSurrender);
+    } else if (name == "deviations") {
+        return flag(cfg.deviations);
+    } else if (name == "csm") {
+        if (value == "off") {
+            cfg.csmTray = -1;
+        } else if (!value.empty() &&
+                   isdigit(static_cast<unsigned char>(value[0]))) {
+            cfg.csmTray = atoi(value.c_str());
+        } else {
+            error = "csm must be off or a tray size";
+            return false;
+        }
+    } else if (name == "payout") {
+        if (value != "3:2" && value != "6:5") {
+            error = "payout must be 3:2 or 6:5";
+            return false;
+        }
+        cfg.rules.sixToFive = value == "6:5";
+    } else if (name == "chart") {
+        cell.chartPath = value == "default" ? string() : value;
+    } else if (name == "count") {
+        cfg.count = value == "none" ? nullptr : findCountSystem(value);
+        if (!cfg.count && value != "none") {
+            error = "count must be none, hilo, ko or omega2";
+            return false;
+        }
+    } else if (name == "ramp") {
+        return parseBetRamp(value, cfg.ramp, error);
+    } else {
+        error = "unknown setting '" + name + "'";
+        return false;
+    }
+    return true;
+}
+
+// Per-thread task deques. A worker takes from the front of its own deque
+// and, once that is empty, steals from the back of another's, so the
+// threads that drew fast cells keep busy while slow ones finish. Tasks
+// never add tasks, so a worker that finds every deque empty is done.
+class WorkStealingPool {
+private:
+    struct Queue {
+        mutex lock;
+        deque<uint64_t> tasks;
+    };
+    vector<unique_ptr<Queue>> queues;
+
+    bool take(size_t self, uint64_t& task) {
+        for (size_t i = 0; i < queues.size(); ++i) {
+            Queue& q = *queues[(self + i) % queues.size()];
+            lock_guard<mutex> guard(q.lock);
+            if (q.tasks.empty()) continue;
+            if (i == 0) {
+                task = q.tasks.front();
+                q.tasks.pop_front();
+            } else {
+                task = q.tasks.back();
+                q.tasks.pop_back();
+            }
+            return true;
+        }
+        return false;
+    }
+
+public:
+    explicit WorkStealingPool(unsigned threads) {
+        for (unsigned i = 0; i < max(1u, threads); ++i) {
+            queues.push_back(make_unique<Queue>());
+        }
+    }
+
+    size_t size() const { return queues.size(); }
+
+    // Call before run() only
+    void push(size_t queue, uint64_t task) {
+        queues[queue % queues.size()]->tasks.push_back(task);
+    }
+
+    // Runs every task as run(worker, task) and returns when all are done
+    template <class Run>
+    void run(Run&& runTask) {
+        vector<thread> workers;
+        for (size_t w = 0; w < queues.size(); ++w) {
+            workers.emplace_back([this, w, &runTask] {
+                uint64_t task;
+                while (take(w, task)) runTask(w, task);
+            });
+        }
+        for (thread& t : workers) t.join();
+    }
+};
+
+bool runSweep(const SimConfig& base, const string& path, long long batch,
+              double targetCi) {
+    ifstream in(path);
+    if (!in) {
+        cerr << "cannot read " << path << "\n";
+        return false;
+    }
+    vector<pair<string, vector<string>>> dims;
+    vector<int> dimLines;
+    string line;
+    int lineNo = 0;
+    while (getline(in, line)) {
+        ++lineNo;
+        size_t hash = line.find('#');
+        if (hash != string::npos) line.erase(hash);
+        istringstream words(line);
+        string name, value;
+        if (!(words >> name)) continue;
+        vector<string> values;
+        while (words >> value) values.push_back(value);
+        if (values.empty()) {
+            cerr << path << ":" << lineNo << ": " << name << " has no values\n";
+            return false;
+        }
+        dims.emplace_back(name, values);
+        dimLines.push_back(lineNo);
+    }
+
+    // Cells in odometer order, the last setting changing fastest
+    vector<unique_ptr<SweepCell>> cells;
+    vector<size_t> pick(dims.size(), 0);
+    long long batches = max(1LL, (base.rounds + batch - 1) / batch);
+    while (true) {
+        auto cell = make_unique<SweepCell>();
+        cell->cfg = base;
+        cell->cfg.threads = 1;
+        cell->cfg.seed = streamSeed(base.seed, cells.size());
+        cell->maxBatches = batches;
+        for (size_t d = 0; d < dims.size(); ++d) {
+            const string& value = dims[d].second[pick[d]];
+            string error;
+            if (!applySweepSetting(dims[d].first, value, *cell, error)) {
+                cerr << path << ":" << dimLines[d] << ": " << error << "\n";
+                return false;
+            }
+            cell->label += (d ? " " : "") + dims[d].first + "=" + value;
+        }
+        withRuleSet(cell->cfg.rules, [&cell](auto rules) {
+            using Rules = decltype(rules);
+            cell->runBatch = &runSweepBatch<Rules>;
+            cell->chart = activeChartLoaded ? activeChart
+                                            : kRulesChart<Rules>;
+        });
+        if (!cell->chartPath.empty()) {
+            string error;
+            if (!loadStrategyChart(cell->chartPath, cell->chart, error)) {
+                cerr << error << "\n";
+                return false;
+            }
+            cell->cfg.chart = &cell->chart;
+        }
+        cells.push_back(move(cell));
+
+        size_t d = dims.size();
+        while (d > 0 && ++pick[d - 1] == dims[d - 1].second.size()) {
+            pick[--d] = 0;
+        }
+        if (d == 0) break;
+    }
+
+    // Batch-major, dealt round-robin: every deque starts with the first
+    // batches of many cells
+    WorkStealingPool pool(base.threads);
+    size_t next = 0;
+    for (long long b = 0; b < batches; ++b) {
+        for (size_t c = 0; c < cells.size(); ++c) {
+            pool.push(next++, (static_cast<uint64_t>(c) << 32) |
+                                  static_cast<uint64_t>(b));
+        }
+    }
+
+    vector<double> busy(pool.size(), 0.0);
+    atomic<long long> skipped{0};
+    auto start = chrono::steady_clock::now();
+    pool.run([&](size_t worker, uint64_t task) {
+        SweepCell& cell = *cells[task >> 32];
+        long long b = static_cast<long long>(task & 0xffffffffu);
+        if (cell.done.load(memory_order_relaxed)) {
+            skipped.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+        auto t0 = chrono::steady_clock::now();
+        SimStats stats;
+        long long rounds = min(batch, cell.cfg.rounds - b * batch);
+        cell.runBatch(cell.cfg, streamSeed(cell.cfg.seed, b), rounds, stats);
+        busy[worker] += chrono::duration<double>(
+            chrono::steady_clock::now() - t0).count();
+
+        lock_guard<mutex> guard(cell.lock);
+        if (cell.done.load(memory_order_relaxed)) return;
+        cell.waiting.emplace(b, stats);
+        for (auto it = cell.waiting.find(cell.mergedBatches);
+             it != cell.waiting.end();
+             it = cell.waiting.find(cell.mergedBatches)) {
+            cell.merged.merge(it->second);
+            cell.waiting.erase(it);
+            ++cell.mergedBatches;
+            bool reached = targetCi > 0.0 && cell.mergedBatches >= 2 &&
+                           100.0 * cell.merged.ci95() <= targetCi;
+            if (reached || cell.mergedBatches == cell.maxBatches) {
+                cell.reachedTarget = reached;
+                cell.done = true;
+                cell.waiting.clear();
+                break;
+            }
+        }
+    });
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    cout << "Sweep:           " << path << ", " << cells.size()
+         << " cells, batches of " << batch << " rounds\n";
+    cout << "Stop at:         " << base.rounds << " rounds";
+    if (targetCi > 0.0) cout << " or +/- " << targetCi << "% (95%)";
+    cout << "\n\n";
+    size_t width = 8;
+    for (const auto& c : cells) width = max(width, c->label.size());
+    cout << "  cell  " << left << setw(static_cast<int>(width)) << "settings"
+         << right << setw(12) << "rounds" << setw(11) << "EV/round"
+         << setw(10) << "+/- 95%" << "\n";
+    long long rounds = 0;
+    for (size_t c = 0; c < cells.size(); ++c) {
+        const SimStats& s = cells[c]->merged;
+        double n = static_cast<double>(max(s.rounds, 1LL));
+        rounds += s.rounds;
+        cout << setw(6) << (c + 1) << "  " << left
+             << setw(static_cast<int>(width)) << cells[c]->label << right
+             << setw(12) << s.rounds << fixed << setprecision(3)
+             << setw(10) << 100.0 * s.net / n << "%"
+             << setw(9) << 100.0 * s.ci95() << "%"
+             << (cells[c]->reachedTarget ? "" : "  (cap)")
+             << defaultfloat << setprecision(6) << "\n";
+    }
+    double work = accumulate(busy.begin(), busy.end(), 0.0);
+    cout << "\nRounds played:   " << rounds << " ("
+         << skipped.load() << " batches skipped after early stops)\n";
+    cout << "Elapsed:         " << elapsed.count() << " s ("
+         << static_cast<long long>(static_cast<double>(rounds) /
+                                   max(elapsed.count(), 1e-9))
+         << " rounds/s), " << pool.size() << " thread(s) "
+         << 100.0 * work / max(elapsed.count() *
+                               static_cast<double>(pool.size()), 1e-9)
+         << "% busy\n";
+    return true;
+}
+
+// --------------------- Script mode ----------------------
+// Batch play of the console game from a script, one directive per line:
+//
+//   start 500          starting bankroll (before the first round only)
+//   round 10 H S       bet 10, then one action per decision: H S D P R,
+//                      or * to play the rest of the round by basic strategy
+//   bankroll 515       check the bankroll after the rounds so far
+//
+// Blank lines and text after '#' are ignored. With a fixed --seed the
+// cards, and so the transcript, are the same on every run.
+struct ScriptStep {
+    int    line = 0;
+    bool   check = false;  // bankroll check, else a round
+    double amount = 0.0;   // bet, or the expected bankroll
+    string actions;        // upper-case action letters
+};
+
+struct Script {
+    string name;
+    double startBankroll = 100.0;
+    vector<ScriptStep> steps;
+};
+
+bool parseScript(istream& in, Script& script, string& error) {
+    string line;
+    int lineNo = 0;
+    while (getline(in, line)) {
+        ++lineNo;
+        size_t hash = line.find('#');
+        if (hash != string::npos) line.erase(hash);
+        istringstream words(line);
+        string directive;
+        if (!(words >> directive)) continue;
+
+        string where = script.name + ":" + to_string(lineNo) + ": ";
+        ScriptStep step;
+        step.line = lineNo;
+        if (!(words >> step.amount)) {
+            error = where + directive + " needs an amount";
+            return false;
+        }
+        if (directive == "start") {
+            if (!script.steps.empty() || step.amount <= 0.0) {
+                error = where + "start must come first and be positive";
+                return false;
+            }
+            script.startBankroll = step.amount;
+            continue;
+        }
+        if (directive == "bankroll") {
+            step.check = true;
+        } else if (directive != "round") {
+            error = where + "unknown directive '" + directive + "'";
+            return false;
+        } else if (step.amount <= 0.0) {
+            error = where + "bet must be positive";
+            return false;
+        }
+
+        string word;
+        while (words >> word) {
+            for (char ch : word) {
+                ch = static_cast<char>(toupper(static_cast<unsigned char>(ch)));
+                if (step.check || !strchr("HSDPR*", ch)) {
+                    error = where + "unexpected '" + word + "'";
+                    return false;
+                }
+                step.actions += ch;
+            }
+        }
+        script.steps.push_back(step);
+    }
+    return true;
+}
+
+BasicAction scriptAction(char ch) {
+    switch (ch) {
+        case 'S': return BasicAction::Stand;
+        case 'D': return BasicAction::DoubleDown;
+        case 'P': return BasicAction::Split;
+        case 'R': return BasicAction::Surrender;
+        default:  return BasicAction::Hit;
+    }
+}
+
+// Block-buffered stdout for transcripts. The console game relies on cin
+// flushing cout before every prompt; a script only needs its bytes in
+// order, so they go out 64 KiB at a time.
+class BufferedOutput : public streambuf {
+    int fd;
+    vector<char> buffer;
+    bool failed = false;
+
+    bool drain() {
+        const char* p = pbase();
+        while (p < pptr() && !failed) {
+            ssize_t n = ::write(fd, p, static_cast<size_t>(pptr() - p));
+            if (n < 0 && errno != EINTR) failed = true;
+            if (n > 0) p += n;
+        }
+        setp(buffer.data(), buffer.data() + buffer.size());
+        return !failed;
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        if (!drain()) return traits_type::eof();
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    int sync() override { return drain() ? 0 : -1; }
+
+public:
+    explicit BufferedOutput(int descriptor, size_t size = 1 << 16)
+        : fd(descriptor), buffer(size) {
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+    ~BufferedOutput() override { drain(); }
+};
+
+struct ScriptResult {
+    long long rounds = 0;
+    long long checks = 0;
+    long long failures = 0;
+    double    bankroll = 0.0;
+    bool      aborted = false;
+};
+
+// Plays the script on the console game's table: StandardRules, one deck.
+// The observer is the transcript; NullObserver makes --quiet free.
+template <class Observer>
+ScriptResult playScript(const Script& script, uint64_t seed, Observer obs,
+                        ostream* transcript) {
+    Deck deck(seed);
+    RoundEngine<StandardRules, Observer> engine(obs);
+    ScriptResult r;
+    r.bankroll = script.startBankroll;
+
+    for (const ScriptStep& step : script.steps) {
+        string where = script.name + ":" + to_string(step.line) + ": ";
+        if (step.check) {
+            ++r.checks;
+            if (fabs(r.bankroll - step.amount) > 1e-9) {
+                ++r.failures;
+                cerr << where << "expected bankroll " << step.amount
+                     << ", got " << r.bankroll << "\n";
+            }
+            continue;
+        }
+        if (step.amount > r.bankroll) {
+            cerr << where << "bet " << step.amount
+                 << " exceeds the bankroll of " << r.bankroll << "\n";
+            r.aborted = true;
+            return r;
+        }
+
+        size_t next = 0;
+        bool basic = false;
+        string error;
+        auto decide = [&](const Hand& hand, int dealerUp, bool canDouble,
+                          bool canSplit, bool canSurrender) {
+            BasicAction suggestion = basicStrategySuggestion(
+                hand, dealerUp, canDouble, canSplit, canSurrender);
+            if (next < step.actions.size() && step.actions[next] == '*') {
+                basic = true;
+                ++next;
+            }
+            BasicAction a = suggestion;
+            if (!basic) {
+                if (next == step.actions.size()) {
+                    if (error.empty()) error = "ran out of actions";
+                    return BasicAction::Stand;
+                }
+                char ch = step.actions[next++];
+                if ((ch == 'D' && !canDouble) || (ch == 'P' && !canSplit) ||
+                    (ch == 'R' && !canSurrender)) {
+                    if (error.empty()) {
+                        error = string("action ") + ch + " is not allowed";
+                    }
+                    return BasicAction::Stand;
+                }
+                a = scriptAction(ch);
+            }
+            if (transcript) {
+                *transcript << "[Basic Strategy Suggestion] "
+                            << actionToString(suggestion) << "\n"
+                            << "Action: " << actionToString(a) << "\n";
+            }
+            return a;
+        };
+
+        if (transcript) *transcript << "\n===== NEW ROUND =====\n";
+        RoundOutcome outcome =
+            engine.play(deck, step.amount, r.bankroll, decide);
+        r.bankroll += outcome.net;
+        ++r.rounds;
+        if (transcript) {
+            *transcript << "Your bankroll: $" << r.bankroll << "\n";
+        }
+        // A trailing * may go unused when the round needs no decisions
+        if (next + 1 == step.actions.size() && step.actions[next] == '*') {
+            ++next;
+        }
+        if (error.empty() && next < step.actions.size()) {
+            error = to_string(step.actions.size() - next) +
+                    " action(s) left over";
+        }
+        if (!error.empty()) {
+            cerr << where << error << "\n";
+            r.aborted = true;
+            return r;
+        }
+    }
+    return r;
+}
+
+bool runScript(const string& path, uint64_t seed, bool quiet) {
+    Script script;
+    script.name = path == "-" ? "<stdin>" : path;
+    string error;
+    bool parsed;
+    if (path == "-") {
+        parsed = parseScript(cin, script, error);
+    } else {
+        ifstream in(path);
+        if (!in) {
+            cerr << "cannot read " << path << "\n";
+            return false;
+        }
+        parsed = parseScript(in, script, error);
+    }
+    if (!parsed) {
+        cerr << error << "\n";
+        return false;
+    }
+
+    BufferedOutput buffer(STDOUT_FILENO);
+    ostream out(&buffer);
+    cout.flush();
+    out << "Script:          " << script.name << "\n";
+    out << "Seed:            " << seed << "\n";
+
+    auto start = chrono::steady_clock::now();
+    ScriptResult r = quiet
+        ? playScript(script, seed, NullObserver{}, nullptr)
+        : playScript(script, seed, ConsoleObserver{&out}, &out);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    if (!quiet) out << "\n";
+    out << "Rounds played:   " << r.rounds << "\n";
+    out << "Final bankroll:  $" << r.bankroll << "\n";
+    out << "Bankroll checks: " << r.checks - r.failures << " of "
+        << r.checks << " passed\n";
+    out << "Elapsed:         " << elapsed.count() << " s\n";
+    out.flush();
+    return !r.aborted && r.failures == 0 && out.good();
+}
+
+// ------------------ Exact EV analysis -------------------
+// Composition-dependent expected values by full enumeration of the
+// remaining cards. Card values follow cardValueForStrategy(): 2-10, and
+// 11 for an ace. EVs are in units of the original bet and assume the
+// dealer has already checked for blackjack, as in the game, so dealer
+// outcomes are conditioned on no dealer natural. Player draws come from
+// the unconditioned remaining shoe.
+struct EvRules {
+    int  decks = 1;
+    bool hitSoft17 = false;        // dealer hits soft 17
+    bool doubleAfterSplit = true;  // never on split aces, which get one card
+    bool lateSurrender = false;
+
+    static EvRules from(const RuleOptions& o) {
+        EvRules r;
+        r.decks = o.decks;
+        r.hitSoft17 = o.hitSoft17;
+        r.doubleAfterSplit = o.doubleAfterSplit;
+        r.lateSurrender = o.lateSurrender;
+        return r;
+    }
+};
+
+// Cards left in the shoe, counted by value
+struct ShoeComposition {
+    array<uint8_t, 12> counts{};   // indices 2-11 used
+    int total = 0;
+
+    static ShoeComposition full(int decks) {
+        ShoeComposition comp;
+        for (int v = 2; v <= 11; ++v) {
+            comp.counts[v] = static_cast<uint8_t>(decks * (v == 10 ? 16 : 4));
+        }
+        comp.total = decks * 52;
+        return comp;
+    }
+
+    bool has(int value) const { return counts[value] > 0; }
+
+    void remove(int value) { counts[value]--; total--; }
+    void add(int value)    { counts[value]++; total++; }
+
+    double prob(int value) const {
+        return static_cast<double>(counts[value]) / total;
+    }
+
+    // "49 cards: 2x4 3x4 ... 10x15 Ax4"
+    string describe() const {
+        ostringstream out;
+        out << total << " cards:";
+        for (int v = 2; v <= 11; ++v) {
+            out << " " << (v == 11 ? "A" : to_string(v)) << "x"
+                << static_cast<int>(counts[v]);
+        }
+        return out.str();
+    }
+};
+
+class EvCalculator {
+public:
+    // Dealer final totals: index 0-4 for 17-21, 5 for bust
+    using DealerDist = array<double, 6>;
+
+    struct ActionEv {
+        double stand = 0.0, hit = 0.0, doubleDown = 0.0, split = 0.0;
+        double surrender = -0.5;
+        bool   canDouble = false, canSplit = false, canSurrender = false;
+
+        BasicAction best() const {
+            BasicAction a = hit > stand ? BasicAction::Hit
+                                        : BasicAction::Stand;
+            double v = max(hit, stand);
+            if (canDouble && doubleDown > v) {
+                a = BasicAction::DoubleDown;
+                v = doubleDown;
+            }
+            if (canSplit && split > v) {
+                a = BasicAction::Split;
+                v = split;
+            }
+            if (canSurrender && surrender > v) a = BasicAction::Surrender;
+            return a;
+        }
+
+        double value(BasicAction a) const {
+            switch (a) {
+                case BasicAction::Hit:        return hit;
+                case BasicAction::Stand:      return stand;
+                case BasicAction::DoubleDown: return doubleDown;
+                case BasicAction::Split:      return split;
+                case BasicAction::Surrender:  return surrender;
+            }
+            return stand;
+        }
+    };
+
+private:
+    // Memo key: the composition plus a small state word
+    struct Key {
+        array<uint8_t, 10> counts;
+        uint16_t state;
+        bool operator==(const Key& o) const {
+            return state == o.state && counts == o.counts;
+        }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            uint64_t h = 0xCBF29CE484222325ULL ^ k.state;
+            for (uint8_t c : k.counts) h = (h ^ c) * 0x100000001B3ULL;
+            return static_cast<size_t>(h);
+        }
+    };
+
+    static Key makeKey(const ShoeComposition& comp, int state) {
+        Key k;
+        for (int v = 2; v <= 11; ++v) k.counts[v - 2] = comp.counts[v];
+        k.state = static_cast<uint16_t>(state);
+        return k;
+    }
+
+    EvRules rules;
+    unordered_map<Key, DealerDist, KeyHash> dealerMemo;
+    unordered_map<Key, double, KeyHash> playerMemo;
+
+    static int bestTotal(int hard, bool ace) {
+        return (ace && hard + 10 <= 21) ? hard + 10 : hard;
+    }
+
+    static int hardValue(int value) { return value == 11 ? 1 : value; }
+
+    // Dealer outcome from a partial hand, drawing from `comp`
+    DealerDist dealerFrom(ShoeComposition& comp, int hard, bool ace) {
+        int total = bestTotal(hard, ace);
+        bool soft = ace && hard + 10 <= 21;
+        DealerDist dist{};
+        if (total > 21) { dist[5] = 1.0; return dist; }
+        if (total >= 17 && !(rules.hitSoft17 && soft && total == 17)) {
+            dist[total - 17] = 1.0;
+            return dist;
+        }
+
+        Key key = makeKey(comp, hard | (ace ? 0x100 : 0));
+        auto it = dealerMemo.find(key);
+        if (it != dealerMemo.end()) return it->second;
+
+        for (int v = 2; v <= 11; ++v) {
+            if (!comp.has(v)) continue;
+            double p = comp.prob(v);
+            comp.remove(v);
+            DealerDist sub = dealerFrom(comp, hard + hardValue(v),
+                                        ace || v == 11);
+            comp.add(v);
+            for (int i = 0; i < 6; ++i) dist[i] += p * sub[i];
+        }
+        dealerMemo.emplace(key, dist);
+        return dist;
+    }
+
+    // Win minus loss probability of standing on `total`
+    double standEv(ShoeComposition& comp, int total, int dealerUp) {
+        if (total > 21) return -1.0;
+        DealerDist d = dealerFinal(comp, dealerUp);
+        double ev = d[5];
+        for (int t = 17; t <= 21; ++t) {
+            if (total > t)      ev += d[t - 17];
+            else if (total < t) ev -= d[t - 17];
+        }
+        return ev;
+    }
+
+    // Best of stand and hit (recursively) for a hand that may not double
+    double playEv(ShoeComposition& comp, int hard, bool ace, int dealerUp) {
+        int total = bestTotal(hard, ace);
+        if (total > 21) return -1.0;
+        Key key = makeKey(comp, hard | (ace ? 0x100 : 0) | (dealerUp << 9));
+        auto it = playerMemo.find(key);
+        if (it != playerMemo.end()) return it->second;
+
+        double best = max(standEv(comp, total, dealerUp),
+                          hitEv(comp, hard, ace, dealerUp));
+        playerMemo.emplace(key, best);
+        return best;
+    }
+
+    double hitEv(ShoeComposition& comp, int hard, bool ace, int dealerUp) {
+        double ev = 0.0;
+        for (int v = 2; v <= 11; ++v) {
+            if (!comp.has(v)) continue;
+            double p = comp.prob(v);
+            comp.remove(v);
+            ev += p * playEv(comp, hard + hardValue(v), ace || v == 11,
+                             dealerUp);
+            comp.add(v);
+        }
+        return ev;
+    }
+
+    double doubleEv(ShoeComposition& comp, int hard, bool ace, int dealerUp) {
+        double ev = 0.0;
+        for (int v = 2; v <= 11; ++v) {
+            if (!comp.has(v)) continue;
+            double p = comp.prob(v);
+            comp.remove(v);
+            ev += p * standEv(comp, bestTotal(hard + hardValue(v),
+                                              ace || v == 11), dealerUp);
+            comp.add(v);
+        }
+        return 2.0 * ev;
+    }
+
+    // Both split hands are valued from the same post-split composition
+    // (the usual approximation); each gets one card, and split aces stop.
+    double splitEv(ShoeComposition& comp, int pairVal, int dealerUp) {
+        bool aces = (pairVal == 11);
+        double ev = 0.0;
+        for (int v = 2; v <= 11; ++v) {
+            if (!comp.has(v)) continue;
+            double p = comp.prob(v);
+            comp.remove(v);
+            int hard = hardValue(pairVal) + hardValue(v);
+            bool ace = aces || v == 11;
+            double hand;
+            if (aces) {
+                hand = standEv(comp, bestTotal(hard, ace), dealerUp);
+            } else {
+                hand = playEv(comp, hard, ace, dealerUp);
+                if (rules.doubleAfterSplit) {
+                    hand = max(hand, doubleEv(comp, hard, ace, dealerUp));
+                }
+            }
+            ev += p * hand;
+            comp.add(v);
+        }
+        return 2.0 * ev;
+    }
+
+public:
+    explicit EvCalculator(const EvRules& r) : rules(r) {}
+
+    const EvRules& getRules() const { return rules; }
+
+    // Dealer final totals for upcard `dealerUp`, given the dealer has no
+    // blackjack. `comp` excludes the upcard.
+    DealerDist dealerFinal(ShoeComposition& comp, int dealerUp) {
+        Key key = makeKey(comp, 0x8000 | dealerUp);
+        auto it = dealerMemo.find(key);
+        if (it != dealerMemo.end()) return it->second;
+
+        DealerDist dist{};
+        double kept = 0.0;
+        for (int hole = 2; hole <= 11; ++hole) {
+            if (!comp.has(hole)) continue;
+            if (dealerUp + hole == 21) continue;  // would be a natural
+            double p = comp.prob(hole);
+            kept += p;
+            comp.remove(hole);
+            DealerDist sub = dealerFrom(comp,
+                                        hardValue(dealerUp) + hardValue(hole),
+                                        dealerUp == 11 || hole == 11);
+            comp.add(hole);
+            for (int i = 0; i < 6; ++i) dist[i] += p * sub[i];
+        }
+        for (double& d : dist) d /= kept;
+        dealerMemo.emplace(key, dist);
+        return dist;
+    }
+
+    // EVs of every action for a hand against `dealerUp`, where `comp`
+    // is the shoe with the player's cards and the upcard already out.
+    // Doubling and splitting are offered on two-card hands only.
+    ActionEv evaluate(ShoeComposition comp, const vector<int>& cards,
+                      int dealerUp, bool allowSplit = true) {
+        int hard = 0;
+        bool ace = false;
+        for (int v : cards) {
+            hard += hardValue(v);
+            ace = ace || v == 11;
+        }
+
+        ActionEv r;
+        r.stand = standEv(comp, bestTotal(hard, ace), dealerUp);
+        r.hit = hitEv(comp, hard, ace, dealerUp);
+        r.canDouble = cards.size() == 2;
+        r.canSplit = allowSplit && cards.size() == 2 && cards[0] == cards[1];
+        r.canSurrender = rules.lateSurrender && cards.size() == 2;
+        if (r.canDouble) r.doubleDown = doubleEv(comp, hard, ace, dealerUp);
+        if (r.canSplit)  r.split = splitEv(comp, cards[0], dealerUp);
+        return r;
+    }
+
+    // Same, starting from a full shoe
+    ActionEv evaluate(const vector<int>& cards, int dealerUp,
+                      bool allowSplit = true) {
+        ShoeComposition comp = ShoeComposition::full(rules.decks);
+        comp.remove(dealerUp);
+        for (int v : cards) comp.remove(v);
+        return evaluate(comp, cards, dealerUp, allowSplit);
+    }
+};
+
+// "A", "K", "10", "7", ... to a strategy card value; 0 if unrecognised
+int parseCardValue(const string& text) {
+    if (text == "A" || text == "a") return 11;
+    if (text == "T" || text == "J" || text == "Q" || text == "K" ||
+        text == "t" || text == "j" || text == "q" || text == "k") return 10;
+    int v = atoi(text.c_str());
+    return (v >= 2 && v <= 10) ? v : 0;
+}
+
+// Representative two-card hand for a chart row
+vector<int> sampleHand(const string& kind, int index) {
+    if (kind == "pair") return { index, index };
+    if (kind == "soft") return { 11, index - 11 };
+    if (index >= 12) return { 10, index - 10 };
+    int low = 2;
+    while (low == index - low) ++low;   // avoid pairs (8 = 2 + 6)
+    return { low, index - low };
+}
+
+// Prints stand/hit/double/split EVs for one hand, where `comp` is the
+// shoe left once the hand and the upcard are out
+void runEvAnalysis(const EvRules& rules, const ShoeComposition& comp,
+                   const vector<int>& cards, int dealerUp) {
+    EvCalculator calc(rules);
+    auto start = chrono::steady_clock::now();
+    EvCalculator::ActionEv ev = calc.evaluate(comp, cards, dealerUp);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    cout << "Hand:";
+    for (int v : cards) cout << " " << cardValueToString(v);
+    cout << "  vs dealer " << cardValueToString(dealerUp)
+         << "  (" << rules.decks << " deck(s), dealer "
+         << (rules.hitSoft17 ? "hits" : "stands on") << " soft 17)\n";
+    cout << "Shoe: " << comp.describe() << "\n";
+    cout << fixed << setprecision(5) << showpos;
+    cout << "  Stand:  " << ev.stand << "\n";
+    cout << "  Hit:    " << ev.hit << "\n";
+    if (ev.canDouble) cout << "  Double: " << ev.doubleDown << "\n";
+    if (ev.canSplit)  cout << "  Split:  " << ev.split << "\n";
+    if (ev.canSurrender) cout << "  Surrender: " << ev.surrender << "\n";
+    cout << noshowpos << defaultfloat;
+    cout << "Best: " << actionToString(ev.best()) << "  ("
+         << elapsed.count() * 1000.0 << " ms)\n";
+}
+
+// Compares every chart cell with the EV-best play for a representative
+// two-card hand and lists the cells where the chart gives up EV.
+void runStrategyAudit(const EvRules& rules, const StrategyChart& chart) {
+    EvCalculator calc(rules);
+    int disagreements = 0;
+    cout << fixed << setprecision(5);
+
+    auto audit = [&](const string& kind, int index) {
+        vector<int> cards = sampleHand(kind, index);
+        Hand hand;
+        for (int v : cards) {
+            hand.addCard({ Suit::Spades, static_cast<Rank>(v) });
+        }
+        for (int up = 2; up <= 11; ++up) {
+            EvCalculator::ActionEv ev =
+                calc.evaluate(cards, up, kind == "pair");
+            BasicAction played = chartSuggestion(
+                chart, hand, up, true, kind == "pair", ev.canSurrender);
+            BasicAction best = ev.best();
+            double loss = ev.value(best) - ev.value(played);
+            if (played != best && loss > 1e-9) {
+                ++disagreements;
+                cout << kind << " " << (kind == "pair"
+                                        ? cardValueToString(index)
+                                        : to_string(index))
+                     << " vs " << cardValueToString(up) << ": chart "
+                     << actionToString(played) << ", best "
+                     << actionToString(best) << " (costs " << loss << ")\n";
+            }
+        }
+    };
+
+    for (int t = 5; t <= 20; ++t)  audit("hard", t);
+    for (int t = 13; t <= 20; ++t) audit("soft", t);
+    for (int v = 2; v <= 11; ++v)  audit("pair", v);
+    cout << defaultfloat;
+    cout << disagreements << " cell(s) differ from the EV-best play.\n";
+}
+
+// ----------------- Optimal chart generator --------------
+// Builds the EV-best chart for a rule set. Every hard and soft cell is
+// decided from a representative two-card hand (the hit/stand choice
+// also stands in for longer hands with the same total) and every pair
+// cell by comparing the split EV with the best non-split play. All the
+// work goes through one EvCalculator, so dealer distributions computed
+// for one cell are reused by the rest.
+StrategyChart generateOptimalChart(const EvRules& rules) {
+    EvCalculator calc(rules);
+    StrategyChart chart = kDefaultChart;
+
+    auto totalCell = [&calc](const vector<int>& cards, int up) {
+        EvCalculator::ActionEv ev = calc.evaluate(cards, up, false);
+        bool hit = ev.hit > ev.stand;
+        double play = max(ev.hit, ev.stand);
+        if (ev.canSurrender && ev.surrender > max(play, ev.doubleDown)) {
+            return hit ? ChartCell::SurrenderHit : ChartCell::SurrenderStand;
+        }
+        if (ev.doubleDown > play) {
+            return hit ? ChartCell::DoubleHit : ChartCell::DoubleStand;
+        }
+        return hit ? ChartCell::Hit : ChartCell::Stand;
+    };
+
+    for (int up = 2; up <= 11; ++up) {
+        int col = up - 2;
+        for (int t = 4; t <= 20; ++t) {
+            vector<int> cards = (t == 4) ? vector<int>{ 2, 2 }
+                                         : sampleHand("hard", t);
+            chart.hard[t][col] = totalCell(cards, up);
+        }
+        chart.hard[21][col] = ChartCell::Stand;
+
+        for (int t = 12; t <= 20; ++t) {
+            vector<int> cards = (t == 12) ? vector<int>{ 11, 11 }
+                                          : sampleHand("soft", t);
+            chart.soft[t][col] = totalCell(cards, up);
+        }
+        chart.soft[21][col] = ChartCell::Stand;
+
+        for (int v = 2; v <= 11; ++v) {
+            EvCalculator::ActionEv ev = calc.evaluate({ v, v }, up, true);
+            double noSplit = max(max(ev.hit, ev.stand), ev.doubleDown);
+            chart.pair[v][col] = ev.split > noSplit ? ChartCell::Split
+                                                    : ChartCell::NoSplit;
+        }
+    }
+    return chart;
+}
+
+void runChartGenerator(const RuleOptions& options) {
+    auto start = chrono::steady_clock::now();
+    StrategyChart chart = generateOptimalChart(EvRules::from(options));
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    cout << "# EV-optimal chart: " << describeRules(options) << "\n";
+    cout << "# generated in " << elapsed.count() << " s\n";
+    writeStrategyChart(cout, chart);
+}
+
+// ------------------ Hand-history replay -----------------
+// Read side of the hand history. The file is mapped read-only and
+// records are used in place, so a query costs one pass over the mapping.
+class HandHistoryReader {
+private:
+    int    fd = -1;
+    void*  map = MAP_FAILED;
+    size_t length = 0;
+
+    const char* bytes() const { return static_cast<const char*>(map); }
+
+public:
+    HandHistoryReader() = default;
+    HandHistoryReader(const HandHistoryReader&) = delete;
+    HandHistoryReader& operator=(const HandHistoryReader&) = delete;
+
+    ~HandHistoryReader() {
+        if (map != MAP_FAILED) munmap(map, length);
+        if (fd >= 0) ::close(fd);
+    }
+
+    bool open(const string& path, string& error) {
+        fd = ::open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            error = "cannot read " + path;
+            return false;
+        }
+        length = static_cast<size_t>(info.st_size);
+        if (length < sizeof(HandHistoryHeader)) {
+            error = path + " is not a hand history";
+            return false;
+        }
+        map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            error = "cannot map " + path;
+            return false;
+        }
+        madvise(map, length, MADV_SEQUENTIAL);
+
+        const HandHistoryHeader& h = header();
+        if (!equal(std::begin(kHistoryMagic), std::end(kHistoryMagic),
+                   h.magic) ||
+            h.version != kHistoryVersion ||
+            h.recordSize != sizeof(HandRecord)) {
+            error = path + " is not a version " + to_string(kHistoryVersion) +
+                    " hand history";
+            return false;
+        }
+        if ((length - sizeof(HandHistoryHeader)) % sizeof(HandRecord) != 0) {
+            error = path + " ends in a partial record";
+            return false;
+        }
+        return true;
+    }
+
+    const HandHistoryHeader& header() const {
+        return *reinterpret_cast<const HandHistoryHeader*>(bytes());
+    }
+
+    size_t size() const {
+        return (length - sizeof(HandHistoryHeader)) / sizeof(HandRecord);
+    }
+
+    const HandRecord* begin() const {
+        return reinterpret_cast<const HandRecord*>(
+            bytes() + sizeof(HandHistoryHeader));
+    }
+    const HandRecord* end() const { return begin() + size(); }
+};
+
+// Best total of `n` card values, and whether an ace counts as 11
+int recordTotal(const uint8_t* values, size_t n, bool* soft = nullptr) {
+    int hard = 0;
+    bool ace = false;
+    for (size_t i = 0; i < n; ++i) {
+        hard += values[i] == 11 ? 1 : values[i];
+        ace |= values[i] == 11;
+    }
+    bool s = ace && hard <= 11;
+    if (soft) *soft = s;
+    return s ? hard + 10 : hard;
+}
+
+// Offset in r.cards of hand h's first card
+size_t recordHandStart(const HandRecord& r, size_t h) {
+    size_t at = r.dealerCards;
+    for (size_t k = 0; k < h; ++k) at += r.handCards[k];
+    return at;
+}
+
+// Result of hand h in units of the initial bet, settled from the cards
+double recordHandResult(const HandHistoryHeader& header, const HandRecord& r,
+                        size_t h) {
+    if (r.flags & kRecSurrendered) return -0.5;
+    if (r.flags & kRecDealerBlackjack) {
+        return (r.flags & kRecPlayerBlackjack) ? 0.0 : -1.0;
+    }
+    if (r.flags & kRecPlayerBlackjack) return header.blackjackPays;
+
+    double stake = ((r.doubled >> h) & 1u) ? 2.0 : 1.0;
+    int player = recordTotal(r.cards + recordHandStart(r, h), r.handCards[h]);
+    int dealer = recordTotal(r.cards, r.dealerCards);
+    if (player > 21) return -stake;
+    if (dealer > 21 || player > dealer) return stake;
+    return player == dealer ? 0.0 : -stake;
+}
+
+// A query on each hand's first two cards: e.g. "16v10" (hard 16),
+// "s18v6" (soft 18) or "16vA", optionally only hands from a split.
+struct HistoryQuery {
+    bool active = false;
+    bool soft = false;
+    int  total = 0;
+    int  up = 0;
+    bool splitOnly = false;
+};
+
+bool parseHistoryQuery(const string& text, HistoryQuery& q) {
+    size_t v = text.find('v');
+    if (v == string::npos || v == 0) return false;
+    string left = text.substr(0, v);
+    q.soft = left[0] == 's';
+    if (q.soft) left = left.substr(1);
+    q.total = atoi(left.c_str());
+    q.up = parseCardValue(text.substr(v + 1));
+    q.active = q.total >= 4 && q.total <= 21 && q.up != 0;
+    return q.active;
+}
+
+bool runReplay(const string& path, const HistoryQuery& query) {
+    HandHistoryReader reader;
+    string error;
+    if (!reader.open(path, error)) {
+        cerr << error << "\n";
+        return false;
+    }
+    const HandHistoryHeader& h = reader.header();
+
+    long long rounds = 0, truncated = 0, mismatches = 0;
+    double net = 0.0, bets = 0.0;
+    array<long long, 5> actions{};
+    long long matched = 0;
+    double matchedNet = 0.0, matchedSquared = 0.0;
+
+    for (const HandRecord& r : reader) {
+        ++rounds;
+        net += r.net;
+        bets += r.bet;
+        for (size_t k = 0; k < r.actionCount; ++k) {
+            actions[r.actions[k] & 0x0f]++;
+        }
+        if (r.flags & kRecTruncated) {
+            ++truncated;
+            continue;
+        }
+
+        // Settle the round again from the cards as a consistency check
+        double settled = 0.0;
+        for (size_t k = 0; k < r.hands; ++k) {
+            settled += recordHandResult(h, r, k) * r.bet;
+        }
+        if (fabs(settled - r.net) > 1e-3 * max(1.0f, r.bet)) ++mismatches;
+
+        if (!query.active || (query.splitOnly && r.hands < 2)) continue;
+        if (r.cards[1] != query.up) continue;
+        for (size_t k = 0; k < r.hands; ++k) {
+            size_t start = recordHandStart(r, k);
+            if (r.handCards[k] < 2) continue;
+            bool soft = false;
+            int total = recordTotal(r.cards + start, 2, &soft);
+            if (total != query.total || soft != query.soft) continue;
+            double x = recordHandResult(h, r, k);
+            ++matched;
+            matchedNet += x;
+            matchedSquared += x * x;
+        }
+    }
+
+    RuleOptions rules;
+    rules.decks = h.decks;
+    rules.hitSoft17 = h.hitSoft17;
+    rules.doubleAfterSplit = h.doubleAfterSplit;
+    rules.resplit = h.resplit;
+    rules.lateSurrender = h.lateSurrender;
+    rules.sixToFive = h.sixToFive;
+
+    cout << "History:         " << path << "\n";
+    cout << "Seed:            " << h.seed << "\n";
+    cout << "Rules:           " << describeRules(rules) << "\n";
+    cout << "Rounds:          " << rounds << "\n";
+    cout << "Net result:      " << net << " units\n";
+    cout << "EV per round:    " << 100.0 * net / max(bets, 1e-9)
+         << "% of initial bet\n";
+    cout << "Decisions:       " << actions[0] << " hit, " << actions[1]
+         << " stand, " << actions[2] << " double, " << actions[3]
+         << " split, " << actions[4] << " surrender\n";
+    if (truncated) cout << "Truncated:       " << truncated << " rounds\n";
+    if (mismatches) {
+        cout << "WARNING: " << mismatches
+             << " rounds do not settle to their recorded net\n";
+    }
+
+    if (query.active) {
+        cout << "\nQuery:           " << (query.soft ? "soft " : "hard ")
+             << query.total << " vs " << cardValueToString(query.up)
+             << (query.splitOnly ? " after a split" : "") << "\n";
+        cout << "Hands:           " << matched << "\n";
+        if (matched > 0) {
+            double m = static_cast<double>(matched);
+            double ev = matchedNet / m;
+            double sd = sqrt(max(matchedSquared / m - ev * ev, 0.0));
+            cout << "EV per hand:     " << ev << " bets (+/- "
+                 << 1.96 * sd / sqrt(m) << " at 95%)\n";
+        }
+    }
+    return mismatches == 0;
+}
+
+// --------------- Batched dealer play-out ----------------
+// Dealer play-out is the same whatever the player does, so simulations
+// that only need dealer outcomes can play many dealers at once. Each
+// lane draws from its own pre-generated stream of card values (2-10,
+// ace = 11); the first two are the hole card and the upcard. Streams are
+// stored card-major, values[k * lanes + lane], so one load fetches card
+// k for eight neighbouring lanes. A dealer scores at least a point per
+// card and has stopped by hard 17, so 17 cards per lane always suffice.
+constexpr int kDealerStreamCards = 17;
+
+struct DealerStreams {
+    size_t lanes = 0;
+    vector<uint8_t> values;
+
+    explicit DealerStreams(size_t count)
+        : lanes(count), values(count * kDealerStreamCards) {}
+
+    uint8_t& at(size_t lane, int k) {
+        return values[static_cast<size_t>(k) * lanes + lane];
+    }
+
+    // Each lane takes the next 17 cards of a round from the shoe
+    void fill(Shoe& shoe) {
+        for (size_t lane = 0; lane < lanes; ++lane) {
+            shoe.prepareRound();
+            for (int k = 0; k < kDealerStreamCards; ++k) {
+                at(lane, k) = static_cast<uint8_t>(
+                    cardValueForStrategy(shoe.deal()));
+            }
+        }
+    }
+};
+
+// Lanes [first, last) one at a time. Writes each final total, 22 for a bust.
+void playOutDealersScalar(const uint8_t* values, size_t lanes,
+                          size_t first, size_t last, bool hitSoft17,
+                          uint8_t* totals) {
+    for (size_t lane = first; lane < last; ++lane) {
+        int hard = 0;
+        bool ace = false;
+        int total = 0;
+        for (int k = 0; k < kDealerStreamCards; ++k) {
+            int v = values[static_cast<size_t>(k) * lanes + lane];
+            ace |= (v == 11);
+            hard += (v == 11) ? 1 : v;
+            bool soft = ace && hard <= 11;
+            total = soft ? hard + 10 : hard;
+            if (k == 0) continue;
+            if (total > 17 || (total == 17 && !(hitSoft17 && soft))) break;
+        }
+        totals[lane] = static_cast<uint8_t>(min(total, 22));
+    }
+}
+
+#ifdef BLACKJACK_AVX2_KERNEL
+// Eight lanes per 256-bit register: per-lane hard totals and ace flags,
+// and a mask of lanes still drawing. A lane that has stopped adds
+// nothing; the batch ends once every lane has stopped.
+__attribute__((target("avx2")))
+void playOutDealersAvx2(const uint8_t* values, size_t lanes,
+                        bool hitSoft17, uint8_t* totals) {
+    const __m256i one       = _mm256_set1_epi32(1);
+    const __m256i ten       = _mm256_set1_epi32(10);
+    const __m256i eleven    = _mm256_set1_epi32(11);
+    const __m256i twelve    = _mm256_set1_epi32(12);
+    const __m256i seventeen = _mm256_set1_epi32(17);
+    const __m256i bust      = _mm256_set1_epi32(22);
+    const __m256i h17       = _mm256_set1_epi32(hitSoft17 ? -1 : 0);
+
+    size_t full = lanes & ~static_cast<size_t>(7);
+    for (size_t base = 0; base < full; base += 8) {
+        __m256i hard = _mm256_setzero_si256();
+        __m256i ace  = _mm256_setzero_si256();
+        __m256i hit  = _mm256_set1_epi32(-1);
+        __m256i soft = _mm256_setzero_si256();
+        __m256i total = _mm256_setzero_si256();
+
+        for (int k = 0; k < kDealerStreamCards; ++k) {
+            const uint8_t* row = values + static_cast<size_t>(k) * lanes;
+            __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(
+                reinterpret_cast<const __m128i*>(row + base)));
+            __m256i isAce = _mm256_cmpeq_epi32(v, eleven);
+            v = _mm256_blendv_epi8(v, one, isAce);
+            hard = _mm256_add_epi32(hard, _mm256_and_si256(v, hit));
+            ace = _mm256_or_si256(ace, _mm256_and_si256(isAce, hit));
+
+            soft = _mm256_and_si256(ace, _mm256_cmpgt_epi32(twelve, hard));
+            total = _mm256_add_epi32(hard, _mm256_and_si256(soft, ten));
+            if (k == 0) continue;
+
+            __m256i under = _mm256_cmpgt_epi32(seventeen, total);
+            __m256i soft17 = _mm256_and_si256(
+                _mm256_and_si256(_mm256_cmpeq_epi32(total, seventeen), soft),
+                h17);
+            hit = _mm256_and_si256(hit, _mm256_or_si256(under, soft17));
+            if (_mm256_testz_si256(hit, hit)) break;
+        }
+
+        alignas(32) int32_t out[8];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(out),
+                           _mm256_min_epi32(total, bust));
+        for (int i = 0; i < 8; ++i) {
+            totals[base + static_cast<size_t>(i)] = static_cast<uint8_t>(out[i]);
+        }
+    }
+    playOutDealersScalar(values, lanes, full, lanes, hitSoft17, totals);
+}
+#endif
+
+bool dealerKernelUsesAvx2() {
+#ifdef BLACKJACK_AVX2_KERNEL
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+// Plays out every lane of `streams`; AVX2 when the CPU has it
+void playOutDealers(const DealerStreams& streams, bool hitSoft17,
+                    uint8_t* totals) {
+#ifdef BLACKJACK_AVX2_KERNEL
+    if (dealerKernelUsesAvx2()) {
+        playOutDealersAvx2(streams.values.data(), streams.lanes,
+                           hitSoft17, totals);
+        return;
+    }
+#endif
+    playOutDealersScalar(streams.values.data(), streams.lanes,
+                         0, streams.lanes, hitSoft17, totals);
+}
+
+// The same lane played through Hand, the way RoundEngine plays a dealer
+int playOutDealerHand(DealerStreams& streams, size_t lane, bool hitSoft17) {
+    Hand dealer;
+    auto card = [](int v) {
+        return Card{ Suit::Clubs, static_cast<Rank>(v) };
+    };
+    dealer.addCard(card(streams.at(lane, 0)));
+    dealer.addCard(card(streams.at(lane, 1)));
+    int k = 2;
+    while (dealer.getValue() < 17 ||
+           (hitSoft17 && dealer.getValue() == 17 && dealer.isSoft())) {
+        dealer.addCard(card(streams.at(lane, k++)));
+    }
+    return min(dealer.getValue(), 22);
+}
+
+// Both kernels against the Hand path on shoe-dealt streams, S17 and H17.
+// The lane count is not a multiple of eight so the scalar tail runs too.
+bool checkDealerKernel() {
+    cout << "Dealer play-out kernel ("
+         << (dealerKernelUsesAvx2() ? "AVX2" : "scalar") << "):\n";
+    BasicShoe<Xoshiro256ss> shoe(6, 0.75, 2024);
+    DealerStreams streams(4099);
+    vector<uint8_t> fast(streams.lanes), scalar(streams.lanes);
+    long long mismatches = 0, lanes = 0;
+    for (int batch = 0; batch < 50; ++batch) {
+        streams.fill(shoe);
+        for (bool h17 : { false, true }) {
+            playOutDealers(streams, h17, fast.data());
+            playOutDealersScalar(streams.values.data(), streams.lanes,
+                                 0, streams.lanes, h17, scalar.data());
+            for (size_t lane = 0; lane < streams.lanes; ++lane) {
+                int expected = playOutDealerHand(streams, lane, h17);
+                if (fast[lane] != expected || scalar[lane] != expected) {
+                    ++mismatches;
+                }
+            }
+            lanes += static_cast<long long>(streams.lanes);
+        }
+    }
+    bool pass = mismatches == 0;
+    cout << "  " << (pass ? "PASS " : "FAIL ") << "matches Hand on "
+         << lanes << " dealer hands (" << mismatches << " mismatches)\n";
+    return pass;
+}
+
+// Final-total distribution by upcard from `hands` dealer hands dealt
+// from the configured shoe and rules
+void runDealerOdds(const SimConfig& cfg, long long hands) {
+    const RuleOptions& rules = cfg.rules;
+    unique_ptr<Shoe> shoe = makeShoe(cfg.rng, rules.decks, cfg.penetration,
+                                     cfg.seed, 0);
+    DealerStreams streams(4096);
+    vector<uint8_t> totals(streams.lanes);
+    // counts[up - 2][total - 17], total 22 = bust
+    array<array<long long, 6>, 10> counts{};
+
+    auto start = chrono::steady_clock::now();
+    long long played = 0;
+    while (played < hands) {
+        streams.fill(*shoe);
+        playOutDealers(streams, rules.hitSoft17, totals.data());
+        size_t n = static_cast<size_t>(
+            min<long long>(hands - played,
+                           static_cast<long long>(streams.lanes)));
+        for (size_t lane = 0; lane < n; ++lane) {
+            counts[streams.at(lane, 1) - 2][totals[lane] - 17]++;
+        }
+        played += static_cast<long long>(n);
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+
+    cout << "Dealer outcomes, " << describeRules(rules) << ", "
+         << played << " hands ("
+         << (dealerKernelUsesAvx2() ? "AVX2" : "scalar") << " kernel, "
+         << elapsed.count() << " s)\n";
+    cout << fixed << setprecision(2);
+    cout << "  up      17      18      19      20      21    bust\n";
+    for (int up = 2; up <= 11; ++up) {
+        const auto& row = counts[up - 2];
+        long long total = accumulate(row.begin(), row.end(), 0LL);
+        if (total == 0) continue;
+        cout << setw(4) << cardValueToString(up);
+        for (long long c : row) {
+            cout << setw(8) << 100.0 * static_cast<double>(c) /
+                                static_cast<double>(total);
+        }
+        cout << "\n";
+    }
+    cout << defaultfloat << setprecision(6);
+    cout << "(percent of hands per upcard; 21 includes dealer blackjacks)\n";
+}
+
+// ---------------------- Game server ---------------------
+// Tables served over a Unix-domain socket (ADDR is a path) or loopback
+// TCP (ADDR is tcp:PORT) with a line protocol. Each connection is one
+// table with its own shoe, bankroll and round engine, dealt under the
+// standard rules from a shoe of --decks decks.
+//
+//   server: WELCOME <bankroll>
+//   client: BET <amount> | HIT | STAND | DOUBLE | SPLIT | SURRENDER | QUIT
+//   server: TURN <hand> <upcard> <cards> <options>  a decision is due
+//           RESULT <net> <bankroll> <dealer cards>  the round is over
+//           ERR <reason> | BYE
+//
+// Cards are comma-separated values, A for an ace; options are letters
+// for the legal plays: H hit, S stand, D double, P split, R surrender.
+//
+// A fixed pool of workers shares the listening socket. Each worker runs
+// its own epoll loop and owns the tables it accepted, so table state is
+// never shared between threads. Table n, counted in accept order over
+// all workers, deals from PCG stream n of the seed.
+struct ServerConfig {
+    string   address;
+    unsigned workers = 1;
+    uint64_t seed = 0;
+    int      decks = 6;
+    double   penetration = 0.75;
+    double   bankroll = 10000.0;  // each table's starting bankroll
+};
+
+// Filled by each worker when it stops
+struct ServerWorkerStats {
+    long long tables = 0;
+    long long rounds = 0;
+    long long commands = 0;
+    double    cpuSeconds = 0.0;
+};
+
+double threadCpuSeconds() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) +
+           static_cast<double>(ts.tv_nsec) * 1e-9;
+}
+
+// Fills a sockaddr for ADDR; returns its length, or 0 if ADDR is invalid
+socklen_t socketAddress(const string& address, sockaddr_storage& storage,
+                        int& family) {
+    storage = sockaddr_storage{};
+    if (address.compare(0, 4, "tcp:") == 0) {
+        int port = atoi(address.c_str() + 4);
+        if (port <= 0 || port > 65535) return 0;
+        auto* in = reinterpret_cast<sockaddr_in*>(&storage);
+        in->sin_family = AF_INET;
+        in->sin_port = htons(static_cast<uint16_t>(port));
+        in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        family = AF_INET;
+        return sizeof(sockaddr_in);
+    }
+    auto* un = reinterpret_cast<sockaddr_un*>(&storage);
+    if (address.empty() || address.size() >= sizeof(un->sun_path)) return 0;
+    un->sun_family = AF_UNIX;
+    copy(address.begin(), address.end(), un->sun_path);
+    family = AF_UNIX;
+    return sizeof(sockaddr_un);
+}
+
+int openListener(const string& address, string& error) {
+    sockaddr_storage addr;
+    int family = 0;
+    socklen_t len = socketAddress(address, addr, family);
+    if (len == 0) {
+        error = "bad address '" + address + "' (use a path or tcp:PORT)";
+        return -1;
+    }
+    int fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        error = string("socket: ") + strerror(errno);
+        return -1;
+    }
+    int on = 1;
+    if (family == AF_INET) {
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    } else {
+        // A socket file left by a server that died would fail the bind;
+        // anything that is not a socket is left alone
+        struct stat st;
+        if (lstat(address.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+            unlink(address.c_str());
+        }
+    }
+    if (bind(fd, reinterpret_cast<sockaddr*>(&addr), len) != 0 ||
+        listen(fd, SOMAXCONN) != 0) {
+        error = "cannot listen on " + address + ": " + strerror(errno);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int connectTo(const string& address, string& error) {
+    sockaddr_storage addr;
+    int family = 0;
+    socklen_t len = socketAddress(address, addr, family);
+    if (len == 0) {
+        error = "bad address '" + address + "'";
+        return -1;
+    }
+    int fd = socket(family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), len) != 0) {
+        error = "cannot connect to " + address + ": " + strerror(errno);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    if (family == AF_INET) {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    return fd;
+}
+
+string handToWire(const Hand& hand) {
+    string out;
+    for (const Card& c : hand) {
+        if (!out.empty()) out += ',';
+        out += cardValueToString(cardValueForStrategy(c));
+    }
+    return out;
+}
+
+// One connection's table. Input is fed in as it arrives; replies collect
+// in `out` until the worker writes them.
+class TableSession {
+private:
+    unique_ptr<Shoe> shoe;
+    RoundEngine<StandardRules> engine;
+    double bankroll;
+    bool   inRound = false;
+    string in;
+
+    void report(ServerWorkerStats& stats) {
+        ostringstream line;
+        if (engine.awaitingDecision()) {
+            line << "TURN " << engine.currentIndex() << " "
+                 << cardValueToString(engine.dealerUp()) << " "
+                 << handToWire(engine.currentHand()) << " "
+                 << (engine.canHit() ? "H" : "") << "S"
+                 << (engine.canDouble() ? "D" : "")
+                 << (engine.canSplit() ? "P" : "")
+                 << (engine.canSurrender() ? "R" : "") << "\n";
+        } else {
+            RoundOutcome o = engine.finish();
+            bankroll += o.net;
+            inRound = false;
+            ++stats.rounds;
+            line << "RESULT " << o.net << " " << bankroll << " "
+                 << handToWire(engine.dealerHand()) << "\n";
+        }
+        out += line.str();
+    }
+
+    void command(const string& text, ServerWorkerStats& stats) {
+        ++stats.commands;
+        istringstream words(text);
+        string verb;
+        words >> verb;
+        for (char& ch : verb) {
+            ch = static_cast<char>(toupper(static_cast<unsigned char>(ch)));
+        }
+
+        if (verb == "BET") {
+            double bet = 0.0;
+            if (inRound) {
+                out += "ERR round in progress\n";
+            } else if (!(words >> bet) || bet <= 0.0 || bet > bankroll) {
+                out += "ERR bet must be positive and within the bankroll\n";
+            } else {
+                engine.begin(*shoe, bet, bankroll);
+                inRound = true;
+                report(stats);
+            }
+            return;
+        }
+        if (verb == "QUIT") {
+            out += "BYE\n";
+            closing = true;
+            return;
+        }
+
+        BasicAction action;
+        if (verb == "HIT")            action = BasicAction::Hit;
+        else if (verb == "STAND")     action = BasicAction::Stand;
+        else if (verb == "DOUBLE")    action = BasicAction::DoubleDown;
+        else if (verb == "SPLIT")     action = BasicAction::Split;
+        else if (verb == "SURRENDER") action = BasicAction::Surrender;
+        else {
+            out += "ERR unknown command\n";
+            return;
+        }
+        if (!inRound) {
+            out += "ERR no round in progress\n";
+        } else if (!engine.apply(action)) {
+            out += "ERR not allowed now\n";
+        } else {
+            report(stats);
+        }
+    }
+
+public:
+    static constexpr size_t kMaxLine = 256;
+
+    string out;
+    bool   closing = false;
+
+    // PCG streams are O(1) to select, unlike xoshiro's one jump per
+    // stream, which matters with thousands of tables per worker
+    TableSession(const ServerConfig& cfg, uint64_t stream)
+        : shoe(makeShoe(RngKind::Pcg, cfg.decks, cfg.penetration,
+                        cfg.seed, stream)),
+          bankroll(cfg.bankroll) {
+        out = "WELCOME " + to_string(static_cast<long long>(bankroll)) + "\n";
+    }
+
+    void feed(const char* data, size_t n, ServerWorkerStats& stats) {
+        in.append(data, n);
+        size_t start = 0, eol;
+        while (!closing && (eol = in.find('\n', start)) != string::npos) {
+            string line = in.substr(start, eol - start);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            command(line, stats);
+            start = eol + 1;
+        }
+        in.erase(0, start);
+        if (in.size() > kMaxLine) {
+            out += "ERR line too long\n";
+            closing = true;
+        }
+    }
+};
+
+// Writes as much of session.out as the socket takes. False on error.
+bool flushSession(int fd, TableSession& session) {
+    while (!session.out.empty()) {
+        ssize_t n = send(fd, session.out.data(), session.out.size(),
+                         MSG_NOSIGNAL);
+        if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+        session.out.erase(0, static_cast<size_t>(n));
+    }
+    return true;
+}
+
+void runServerWorker(int listenFd, const ServerConfig& cfg,
+                     atomic<uint64_t>& nextStream, const atomic<bool>& stop,
+                     ServerWorkerStats& stats) {
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.fd = listenFd;
+    epoll_ctl(ep, EPOLL_CTL_ADD, listenFd, &ev);
+
+    unordered_map<int, unique_ptr<TableSession>> sessions;
+    array<epoll_event, 256> events;
+    char buffer[4096];
+
+    auto watch = [ep](int fd, bool wantWrite) {
+        epoll_event e{};
+        e.events = EPOLLIN | EPOLLRDHUP | (wantWrite ? EPOLLOUT : 0u);
+        e.data.fd = fd;
+        epoll_ctl(ep, EPOLL_CTL_MOD, fd, &e);
+    };
+    auto drop = [ep, &sessions](int fd) {
+        epoll_ctl(ep, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        sessions.erase(fd);
+    };
+
+    while (!stop.load(memory_order_relaxed)) {
+        int n = epoll_wait(ep, events.data(), static_cast<int>(events.size()),
+                           100);
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd) {
+                int client;
+                while ((client = accept4(listenFd, nullptr, nullptr,
+                                         SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                    // Tables are numbered in accept order across workers
+                    uint64_t stream = nextStream.fetch_add(
+                        1, memory_order_relaxed);
+                    auto session = make_unique<TableSession>(cfg, stream);
+                    epoll_event e{};
+                    e.events = EPOLLIN | EPOLLRDHUP;
+                    e.data.fd = client;
+                    epoll_ctl(ep, EPOLL_CTL_ADD, client, &e);
+                    ++stats.tables;
+                    bool ok = flushSession(client, *session);
+                    auto& slot = sessions[client];
+                    slot = move(session);
+                    if (!ok) drop(client);
+                    else if (!slot->out.empty()) watch(client, true);
+                }
+                continue;
+            }
+
+            auto it = sessions.find(fd);
+            if (it == sessions.end()) continue;
+            TableSession& session = *it->second;
+            bool alive = true;
+            if (events[i].events & EPOLLIN) {
+                ssize_t got;
+                while ((got = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+                    session.feed(buffer, static_cast<size_t>(got), stats);
+                }
+                if (got == 0 || (got < 0 && errno != EAGAIN &&
+                                 errno != EWOULDBLOCK)) {
+                    alive = false;
+                }
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) alive = false;
+            if (alive) alive = flushSession(fd, session);
+            if (!alive || (session.closing && session.out.empty())) {
+                drop(fd);
+            } else {
+                watch(fd, !session.out.empty());
+            }
+        }
+    }
+
+    for (auto& s : sessions) close(s.first);
+    close(ep);
+    stats.cpuSeconds = threadCpuSeconds();
+}
+
+// Runs the worker pool on an open listener until `stop` is set
+vector<ServerWorkerStats> serveOn(int listenFd, const ServerConfig& cfg,
+                                  const atomic<bool>& stop) {
+    vector<ServerWorkerStats> stats(cfg.workers);
+    atomic<uint64_t> nextStream{0};
+    vector<thread> workers;
+    for (unsigned w = 0; w < cfg.workers; ++w) {
+        workers.emplace_back([&, w] {
+            runServerWorker(listenFd, cfg, nextStream, stop, stats[w]);
+        });
+    }
+    for (auto& t : workers) t.join();
+    return stats;
+}
+
+bool runServer(const ServerConfig& cfg) {
+    string error;
+    int fd = openListener(cfg.address, error);
+    if (fd < 0) {
+        cerr << error << "\n";
+        return false;
+    }
+    cout << "Serving tables on " << cfg.address << " with " << cfg.workers
+         << " worker(s)\n";
+
+    // SIGINT or SIGTERM stops the workers, which see `stop` within one
+    // epoll timeout. Blocked here so every thread started below inherits
+    // the mask and only sigwait() receives them.
+    sigset_t quit;
+    sigemptyset(&quit);
+    sigaddset(&quit, SIGINT);
+    sigaddset(&quit, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &quit, nullptr);
+    atomic<bool> stop{false};
+    thread waiter([&quit, &stop] {
+        int sig = 0;
+        sigwait(&quit, &sig);
+        stop = true;
+    });
+    vector<ServerWorkerStats> stats = serveOn(fd, cfg, stop);
+    waiter.join();
+
+    close(fd);
+    if (cfg.address.compare(0, 4, "tcp:") != 0) unlink(cfg.address.c_str());
+    long long tables = 0, rounds = 0;
+    for (const auto& s : stats) {
+        tables += s.tables;
+        rounds += s.rounds;
+    }
+    cout << "Stopped after " << tables << " table(s), " << rounds
+         << " round(s)\n";
+    return true;
+}
+
+// ------------------- Load generator ---------------------
+// Opens `tables` connections and plays `rounds` rounds on each with
+// basicStrategySuggestion, one request in flight per table. Latency is
+// measured from sending a command to receiving its reply. With ADDR
+// "self" the server runs in this process on a temporary socket, so its
+// CPU time can be measured as well.
+struct LoadClient {
+    int    fd = -1;
+    string in;
+    int    roundsLeft = 0;
+    chrono::steady_clock::time_point sent;
+};
+
+BasicAction loadgenDecision(const string& upText, const string& cards,
+                            const string& options) {
+    Hand hand;
+    istringstream list(cards);
+    string card;
+    while (getline(list, card, ',')) {
+        hand.addCard(Card{ Suit::Clubs,
+                           static_cast<Rank>(parseCardValue(card)) });
+    }
+    auto has = [&options](char c) {
+        return options.find(c) != string::npos;
+    };
+    BasicAction a = basicStrategySuggestion(hand, parseCardValue(upText),
+                                            has('D'), has('P'), has('R'));
+    if (a == BasicAction::Hit && !has('H')) a = BasicAction::Stand;
+    return a;
+}
+
+bool runLoadGenerator(const ServerConfig& serverCfg, int tables, int rounds) {
+    // Two descriptors per table when the server is in-process
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+        limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    ServerConfig cfg = serverCfg;
+    bool inProcess = cfg.address == "self";
+    atomic<bool> stop{false};
+    vector<ServerWorkerStats> serverStats;
+    thread server;
+    int listenFd = -1;
+    if (inProcess) {
+        cfg.address = "/tmp/blackjack-" + to_string(getpid()) + ".sock";
+        string error;
+        listenFd = openListener(cfg.address, error);
+        if (listenFd < 0) {
+            cerr << error << "\n";
+            return false;
+        }
+        server = thread([&] { serverStats = serveOn(listenFd, cfg, stop); });
+    }
+
+    auto shutdown = [&] {
+        if (!inProcess) return;
+        stop = true;
+        server.join();
+        close(listenFd);
+        unlink(cfg.address.c_str());
+    };
+
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    vector<LoadClient> clients(static_cast<size_t>(tables));
+    for (size_t i = 0; i < clients.size(); ++i) {
+        string error;
+        clients[i].fd = connectTo(cfg.address, error);
+        if (clients[i].fd < 0) {
+            cerr << error << "\n";
+            for (size_t k = 0; k < i; ++k) close(clients[k].fd);
+            close(ep);
+            shutdown();
+            return false;
+        }
+        clients[i].roundsLeft = rounds;
+        epoll_event e{};
+        e.events = EPOLLIN;
+        e.data.u64 = i;
+        epoll_ctl(ep, EPOLL_CTL_ADD, clients[i].fd, &e);
+    }
+
+    vector<uint32_t> latencies;  // ns
+    latencies.reserve(static_cast<size_t>(tables) *
+                      static_cast<size_t>(rounds) * 3);
+    long long roundsDone = 0, errors = 0;
+    size_t remaining = clients.size();
+    array<epoll_event, 256> events;
+    char buffer[4096];
+
+    auto sendLine = [](LoadClient& c, const string& line) {
+        c.sent = chrono::steady_clock::now();
+        return send(c.fd, line.data(), line.size(), MSG_NOSIGNAL) ==
+               static_cast<ssize_t>(line.size());
+    };
+    auto finishClient = [&](LoadClient& c) {
+        epoll_ctl(ep, EPOLL_CTL_DEL, c.fd, nullptr);
+        close(c.fd);
+        c.fd = -1;
+        --remaining;
+    };
+
+    auto start = chrono::steady_clock::now();
+    while (remaining > 0) {
+        int n = epoll_wait(ep, events.data(), static_cast<int>(events.size()),
+                           1000);
+        for (int i = 0; i < n; ++i) {
+            LoadClient& c = clients[events[i].data.u64];
+            if (c.fd < 0) continue;
+            ssize_t got = recv(c.fd, buffer, sizeof(buffer), 0);
+            if (got <= 0) {
+                ++errors;
+                finishClient(c);
+                continue;
+            }
+            c.in.append(buffer, static_cast<size_t>(got));
+            size_t eol;
+            while (c.fd >= 0 && (eol = c.in.find('\n')) != string::npos) {
+                auto now = chrono::steady_clock::now();
+                string line = c.in.substr(0, eol);
+                c.in.erase(0, eol + 1);
+                istringstream words(line);
+                string verb;
+                words >> verb;
+
+                string next;
+                if (verb == "WELCOME") {
+                    next = "BET 1\n";
+                } else if (verb == "TURN") {
+                    latencies.push_back(static_cast<uint32_t>(
+                        chrono::duration_cast<chrono::nanoseconds>(
+                            now - c.sent).count()));
+                    string hand, up, cards, options;
+                    words >> hand >> up >> cards >> options;
+                    switch (loadgenDecision(up, cards, options)) {
+                        case BasicAction::Hit:        next = "HIT\n"; break;
+                        case BasicAction::Stand:      next = "STAND\n"; break;
+                        case BasicAction::DoubleDown: next = "DOUBLE\n"; break;
+                        case BasicAction::Split:      next = "SPLIT\n"; break;
+                        case BasicAction::Surrender:  next = "SURRENDER\n";
+                                                      break;
+                    }
+                } else if (verb == "RESULT") {
+                    latencies.push_back(static_cast<uint32_t>(
+                        chrono::duration_cast<chrono::nanoseconds>(
+                            now - c.sent).count()));
+                    ++roundsDone;
+                    next = --c.roundsLeft > 0 ? "BET 1\n" : "QUIT\n";
+                } else if (verb == "BYE") {
+                    finishClient(c);
+                    continue;
+                } else {
+                    ++errors;
+                    next = "QUIT\n";
+                }
+                if (!sendLine(c, next)) {
+                    ++errors;
+                    finishClient(c);
+                }
+            }
+        }
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    close(ep);
+    shutdown();
+
+    sort(latencies.begin(), latencies.end());
+    auto pct = [&latencies](double p) {
+        if (latencies.empty()) return 0.0;
+        size_t rank = static_cast<size_t>(
+            ceil(p * static_cast<double>(latencies.size())));
+        return latencies[min(latencies.size() - 1, rank > 0 ? rank - 1 : 0)]
+               / 1000.0;
+    };
+    double secs = max(elapsed.count(), 1e-9);
+    cout << "Tables / rounds: " << tables << " x " << rounds << " ("
+         << roundsDone << " rounds played, " << errors << " errors)\n";
+    cout << "Elapsed:         " << secs << " s, "
+         << static_cast<long long>(static_cast<double>(roundsDone) / secs)
+         << " rounds/s, "
+         << static_cast<long long>(static_cast<double>(latencies.size()) /
+                                   secs)
+         << " actions/s\n";
+    cout << "Latency (us):    p50 " << pct(0.5) << ", p99 " << pct(0.99)
+         << ", max " << pct(1.0) << "\n";
+    if (inProcess) {
+        double cpu = 0.0;
+        for (const auto& s : serverStats) cpu += s.cpuSeconds;
+        double perCpuSecond = static_cast<double>(roundsDone) /
+                              max(cpu, 1e-9);
+        cout << "Server CPU:      " << cpu << " s over " << cfg.workers
+             << " worker(s), " << static_cast<long long>(perCpuSecond)
+             << " rounds per CPU-second\n";
+        cout << "Tables per core: "
+             << static_cast<long long>(perCpuSecond * 10.0)
+             << " at one round every 10 s per table\n";
+    }
+    return errors == 0;
+}
+
+// ------------------- RNG checks -------------------------
+// Shuffle throughput per generator, and chi-square uniformity checks so
+// a faster generator can be trusted not to bias the cards.
+
+// Nanoseconds per shuffle of an n-card array
+template <class Shuffle>
+double timeShuffles(size_t n, long long reps, Shuffle&& shuffle) {
+    vector<uint16_t> cards(n);
+    iota(cards.begin(), cards.end(), 0);
+    uint64_t checksum = 0;
+    for (long long i = 0; i < reps / 10; ++i) shuffle(cards);  // warm-up
+
+    auto start = chrono::steady_clock::now();
+    for (long long i = 0; i < reps; ++i) {
+        shuffle(cards);
+        checksum += cards[0];
+    }
+    chrono::duration<double, nano> elapsed =
+        chrono::steady_clock::now() - start;
+    // Keeps the loop from being optimised away
+    if (checksum == 1) cout << "";
+    return elapsed.count() / static_cast<double>(reps);
+}
+
+template <class Rng>
+void benchGenerator(const string& label, Rng rng) {
+    cout << "  " << left << setw(28) << label << right;
+    for (size_t n : { size_t(52), size_t(416) }) {
+        long long reps = n == 52 ? 400000 : 50000;
+        double ns = timeShuffles(n, reps, [&rng](vector<uint16_t>& c) {
+            fisherYates(c.begin(), c.end(), rng);
+        });
+        cout << setw(10) << fixed << setprecision(1) << ns << " ns";
+    }
+    cout << defaultfloat << "\n";
+}
+
+void runRngBenchmark() {
+    cout << "Shuffle cost per shoe           52 cards   416 cards\n";
+    {
+        mt19937 mt(12345);
+        cout << "  std::shuffle + mt19937      ";
+        for (size_t n : { size_t(52), size_t(416) }) {
+            long long reps = n == 52 ? 400000 : 50000;
+            double ns = timeShuffles(n, reps, [&mt](vector<uint16_t>& c) {
+                std::shuffle(c.begin(), c.end(), mt);
+            });
+            cout << setw(10) << fixed << setprecision(1) << ns << " ns";
+        }
+        cout << defaultfloat << "\n";
+    }
+    benchGenerator(string("Fisher-Yates + ") + Mt19937Rng::name,
+                   Mt19937Rng(12345));
+    benchGenerator(string("Fisher-Yates + ") + Xoshiro256ss::name,
+                   Xoshiro256ss(12345));
+    benchGenerator(string("Fisher-Yates + ") + Pcg64::name, Pcg64(12345));
+}
+
+// Upper 0.1% point of the chi-square distribution with `df` degrees of
+// freedom (Wilson–Hilferty approximation)
+double chiSquareCritical(double df) {
+    const double z = 3.0902;
+    double a = 2.0 / (9.0 * df);
+    return df * pow(1.0 - a + z * sqrt(a), 3.0);
+}
+
+double chiSquare(const vector<long long>& counts, double expected) {
+    double chi = 0.0;
+    for (long long c : counts) {
+        double d = static_cast<double>(c) - expected;
+        chi += d * d / expected;
+    }
+    return chi;
+}
+
+bool reportCheck(const string& name, double chi, double df) {
+    double critical = chiSquareCritical(df);
+    bool pass = chi < critical;
+    cout << "  " << (pass ? "PASS " : "FAIL ") << name << ": chi2 = "
+         << fixed << setprecision(1) << chi << " (df " << df
+         << ", limit " << critical << ")" << defaultfloat << "\n";
+    return pass;
+}
+
+template <class Rng>
+bool checkGenerator(Rng rng) {
+    cout << Rng::name << ":\n";
+    bool ok = true;
+
+    // boundedRand() on a range that does not divide 2^32
+    {
+        const uint32_t range = 416;
+        const long long draws = 4160000;
+        vector<long long> counts(range);
+        for (long long i = 0; i < draws; ++i) counts[boundedRand(rng, range)]++;
+        ok &= reportCheck("bounded [0,416)", chiSquare(counts,
+                          static_cast<double>(draws) / range), range - 1);
+    }
+
+    // All 24 orders of a 4-card shuffle equally likely
+    {
+        const long long shuffles = 240000;
+        vector<long long> counts(24);
+        array<int, 4> cards;
+        for (long long i = 0; i < shuffles; ++i) {
+            cards = { 0, 1, 2, 3 };
+            fisherYates(cards.begin(), cards.end(), rng);
+            int code = 0;  // Lehmer code of the permutation
+            for (int a = 0; a < 4; ++a) {
+                int smaller = 0;
+                for (int b = a + 1; b < 4; ++b) {
+                    if (cards[b] < cards[a]) ++smaller;
+                }
+                code = code * (4 - a) + smaller;
+            }
+            counts[code]++;
+        }
+        ok &= reportCheck("4-card permutations",
+                          chiSquare(counts, shuffles / 24.0), 23);
+    }
+
+    // Every card equally likely in every position of a 52-card deck
+    {
+        const long long shuffles = 104000;
+        vector<long long> counts(52 * 52);
+        vector<int> cards(52);
+        for (long long i = 0; i < shuffles; ++i) {
+            iota(cards.begin(), cards.end(), 0);
+            fisherYates(cards.begin(), cards.end(), rng);
+            for (int pos = 0; pos < 52; ++pos) counts[cards[pos] * 52 + pos]++;
+        }
+        ok &= reportCheck("52-card positions",
+                          chiSquare(counts, shuffles / 52.0), 51 * 51);
+    }
+    return ok;
+}
+
+// A CSM that always hands out its lowest card, to make rounds as long as
+// they can get
+class LowCardShoe : public BasicShoe<Xoshiro256ss> {
+protected:
+    uint32_t randomBelow(uint32_t range) override {
+        auto hard = [](const Card& card) {  // aces low
+            int v = static_cast<int>(card.rank);
+            return v == 11 ? 1 : v;
+        };
+        const vector<Card>& c = cardArray();
+        size_t first = c.size() - range, low = first;
+        for (size_t i = first; i < c.size(); ++i) {
+            if (hard(c[i]) < hard(c[low])) low = i;
+        }
+        return static_cast<uint32_t>(low - first);
+    }
+
+public:
+    LowCardShoe() : BasicShoe(1, 0.75, uint64_t(2024)) {}
+};
+
+// Splits every pair and hits to 21
+BasicAction lowCardPlay(const Hand& hand, int, bool, bool canSplit, bool) {
+    if (canSplit) return BasicAction::Split;
+    return hand.getValue() < 21 ? BasicAction::Hit : BasicAction::Stand;
+}
+
+// The largest one-deck table the seat limit allows, dealt low cards in
+// the worst order, must finish its rounds inside the shoe
+bool checkLowCardRound() {
+    const int seats = 5;
+    LowCardShoe shoe;
+    shoe.useContinuousShuffler(0);
+    TableEngine<StandardRules> table;
+    for (int i = 0; i < seats; ++i) table.addSeat({ lowCardPlay });
+    size_t most = 0;
+    for (int r = 0; r < 20; ++r) {
+        table.playRound(shoe);
+        most = max(most, shoe.size() - shoe.cardsRemaining());
+    }
+    bool pass = !Shoe::roundCanEmptyShoe(1, seats * StandardRules::maxHands) &&
+                most < shoe.size();
+    cout << "  " << (pass ? "PASS " : "FAIL ") << "low-card round, ideal machine, "
+         << seats << " seats used " << most << " of " << shoe.size()
+         << " cards\n";
+    return pass;
+}
+
+// A one-deck CSM with a five-card tray: the first card of a round is
+// any card with its deck frequency, and a round that deals the whole
+// deck finds every card still there
+bool checkContinuousShuffler() {
+    cout << "Continuous shuffler (1 deck):\n";
+    BasicShoe<Xoshiro256ss> shoe(1, 0.75, 2024);
+    shoe.useContinuousShuffler(5);
+    auto cell = [](const Card& c) {  // suit x value, tens share a cell
+        return static_cast<int>(c.suit) * 10 + static_cast<int>(c.rank) - 2;
+    };
+    array<long long, 40> deck{};
+    for (int i = 0; i < 52; ++i) deck[cell(shoe.deal())]++;
+
+    const long long rounds = 208000;
+    array<long long, 40> first{};
+    long long lost = 0;
+    for (long long r = 0; r < rounds; ++r) {
+        shoe.prepareRound();
+        if (r % 1000 == 999) {
+            array<long long, 40> seen{};
+            for (int i = 0; i < 52; ++i) seen[cell(shoe.deal())]++;
+            if (seen != deck) ++lost;
+            continue;
+        }
+        first[cell(shoe.deal())]++;
+        for (long long i = 0; i < 3 + r % 5; ++i) shoe.deal();
+    }
+
+    double dealt = static_cast<double>(rounds - rounds / 1000);
+    double chi = 0.0;
+    for (int i = 0; i < 40; ++i) {
+        double expected = dealt * static_cast<double>(deck[i]) / 52.0;
+        double d = static_cast<double>(first[i]) - expected;
+        chi += d * d / expected;
+    }
+    bool ok = reportCheck("first card of a round, 5-card tray", chi, 39);
+    bool kept = lost == 0;
+    cout << "  " << (kept ? "PASS " : "FAIL ") << "whole deck dealt "
+         << rounds / 1000 << " times (" << lost << " with cards missing)\n";
+    return ok && kept && checkLowCardRound();
+}
+
+// Fixed-seed checks; returns false if any fails
+bool runSelfTest() {
+    bool ok = true;
+    ok &= checkGenerator(Mt19937Rng(2024));
+    ok &= checkGenerator(Xoshiro256ss(2024));
+    ok &= checkGenerator(Pcg64(2024));
+    ok &= checkDealerKernel();
+    ok &= checkContinuousShuffler();
+    cout << (ok ? "All self-tests passed.\n" : "Self-test FAILED.\n");
+    return ok;
+}
+
+// ---------------------- Benchmarks ----------------------
+// Times each hot primitive of a round. Every benchmark runs a batch of
+// operations per repetition; after warm-up batches, the per-operation
+// time of each repetition is collected and summarised by median and
+// percentiles, so one slow repetition doesn't move the headline number.
+struct BenchResult {
+    string name;
+    long long opsPerRep = 0;
+    int    reps = 0;
+    double medianNs = 0.0, p10Ns = 0.0, p90Ns = 0.0, p99Ns = 0.0;
+
+    double opsPerSec() const { return 1e9 / medianNs; }
+};
+
+// Results land here so the compiler can't drop the measured work
+volatile uint64_t benchSink = 0;
+constexpr int kBenchWarmups = 3;
+
+// `body(ops)` performs `ops` operations and returns a checksum
+template <class Body>
+BenchResult runBench(const string& name, long long opsPerRep, int reps,
+                     Body&& body) {
+    for (int i = 0; i < kBenchWarmups; ++i) {
+        benchSink = benchSink + body(opsPerRep);
+    }
+
+    vector<double> samples;
+    samples.reserve(static_cast<size_t>(reps));
+    for (int r = 0; r < reps; ++r) {
+        auto start = chrono::steady_clock::now();
+        uint64_t check = body(opsPerRep);
+        chrono::duration<double, nano> elapsed =
+            chrono::steady_clock::now() - start;
+        benchSink = benchSink + check;
+        samples.push_back(elapsed.count() / static_cast<double>(opsPerRep));
+    }
+    sort(samples.begin(), samples.end());
+
+    // Nearest-rank percentile
+    auto pct = [&samples](double p) {
+        size_t rank = static_cast<size_t>(ceil(p * samples.size()));
+        return samples[min(samples.size() - 1, rank > 0 ? rank - 1 : 0)];
+    };
+    BenchResult r;
+    r.name = name;
+    r.opsPerRep = opsPerRep;
+    r.reps = reps;
+    r.medianNs = pct(0.5);
+    r.p10Ns = pct(0.1);
+    r.p90Ns = pct(0.9);
+    r.p99Ns = pct(0.99);
+    return r;
+}
+
+// Random two-to-four-card hands and upcards for the per-hand benchmarks
+struct BenchHands {
+    vector<Hand> hands;
+    vector<int>  upcards;
+
+    explicit BenchHands(size_t count) {
+        BasicShoe<Xoshiro256ss> shoe(6, 0.75, 99);
+        Xoshiro256ss rng(7);
+        for (size_t i = 0; i < count; ++i) {
+            shoe.prepareRound();
+            Hand h;
+            int cards = 2 + static_cast<int>(boundedRand(rng, 3));
+            for (int c = 0; c < cards; ++c) h.addCard(shoe.deal());
+            if (h.isBust()) { --i; continue; }
+            hands.push_back(h);
+            upcards.push_back(2 + static_cast<int>(boundedRand(rng, 10)));
+        }
+    }
+};
+
+vector<BenchResult> runBenchmarks(int reps) {
+    vector<BenchResult> results;
+    BasicShoe<Xoshiro256ss> shoe(6, 0.75, 1);
+    BenchHands sample(4096);
+    const size_t mask = sample.hands.size() - 1;
+
+    results.push_back(runBench("Shoe::shuffle (6 decks)", 2000, reps,
+        [&shoe](long long ops) {
+            uint64_t sum = 0;
+            for (long long i = 0; i < ops; ++i) {
+                shoe.shuffle();
+                sum += static_cast<uint64_t>(shoe.deal().rank);
+            }
+            return sum;
+        }));
+
+    results.push_back(runBench("Shoe::deal (6 decks, incl. reshuffles)",
+                               1000000, reps, [&shoe](long long ops) {
+            uint64_t sum = 0;
+            for (long long i = 0; i < ops; ++i) {
+                if (shoe.needsShuffle()) shoe.prepareRound();
+                sum += static_cast<uint64_t>(shoe.deal().rank);
+            }
+            return sum;
+        }));
+
+    results.push_back(runBench("Hand::getValue", 1000000, reps,
+        [&sample, mask](long long ops) {
+            uint64_t sum = 0;
+            for (long long i = 0; i < ops; ++i) {
+                sum += static_cast<uint64_t>(
+                    sample.hands[static_cast<size_t>(i) & mask].getValue());
+            }
+            return sum;
+        }));
+
+    results.push_back(runBench("Hand::isSoft", 1000000, reps,
+        [&sample, mask](long long ops) {
+            uint64_t sum = 0;
+            for (long long i = 0; i < ops; ++i) {
+                sum += sample.hands[static_cast<size_t>(i) & mask].isSoft();
+            }
+            return sum;
+        }));
+
+    results.push_back(runBench("basicStrategySuggestion", 1000000, reps,
+        [&sample, mask](long long ops) {
+            uint64_t sum = 0;
+            for (long long i = 0; i < ops; ++i) {
+                size_t k = static_cast<size_t>(i) & mask;
+                const Hand& h = sample.hands[k];
+                sum += static_cast<uint64_t>(basicStrategySuggestion(
+                    h, sample.upcards[k], h.size() == 2, isPair(h)));
+            }
+            return sum;
+        }));
+
+    results.push_back(runBench("dealer play-out (S17)", 200000, reps,
+        [&shoe](long long ops) {
+            uint64_t sum = 0;
+            for (long long i = 0; i < ops; ++i) {
+                shoe.prepareRound();
+                Hand dealer;
+                dealer.addCard(shoe.deal());
+                dealer.addCard(shoe.deal());
+                while (dealer.getValue() < 17) dealer.addCard(shoe.deal());
+                sum += static_cast<uint64_t>(dealer.getValue());
+            }
+            return sum;
+        }));
+
+    DealerStreams streams(4096);
+    streams.fill(shoe);
+    vector<uint8_t> totals(streams.lanes);
+    results.push_back(runBench(string("batched dealer play-out (S17, ") +
+                               (dealerKernelUsesAvx2() ? "AVX2" : "scalar") +
+                               ")", 50 * 4096, reps,
+        [&streams, &totals](long long ops) {
+            // One op is one dealer hand; a call plays 4096 of them
+            uint64_t sum = 0;
+            for (long long i = 0; i < ops; i += 4096) {
+                playOutDealers(streams, false, totals.data());
+                sum += totals[static_cast<size_t>(i / 4096) & 4095];
+            }
+            return sum;
+        }));
+
+    RoundEngine<StandardRules> engine;
+    BasicShoe<Xoshiro256ss> deck(1, 0.75, 2);
+    results.push_back(runBench("full round (standard rules)", 200000, reps,
+        [&engine, &deck](long long ops) {
+            double net = 0.0;
+            for (long long i = 0; i < ops; ++i) {
+                net += engine.play(deck, 1.0,
+                                   numeric_limits<double>::infinity(),
+                                   basicStrategyFor<StandardRules>).net;
+            }
+            return static_cast<uint64_t>(net + 1e9);
+        }));
+    return results;
+}
+
+void printBenchTable(const vector<BenchResult>& results) {
+    cout << left << setw(40) << "benchmark" << right
+         << setw(10) << "median" << setw(10) << "p10" << setw(10) << "p90"
+         << setw(10) << "p99" << setw(14) << "ops/s" << "\n";
+    cout << fixed << setprecision(2);
+    for (const BenchResult& r : results) {
+        cout << left << setw(40) << r.name << right
+             << setw(10) << r.medianNs << setw(10) << r.p10Ns
+             << setw(10) << r.p90Ns << setw(10) << r.p99Ns
+             << setw(14) << setprecision(0) << r.opsPerSec()
+             << setprecision(2) << "\n";
+    }
+    cout << defaultfloat << "(times in ns per operation)\n";
+}
+
+void writeBenchJson(ostream& out, const vector<BenchResult>& results) {
+    out << "{\n  \"unit\": \"ns/op\",\n  \"warmup_reps\": " << kBenchWarmups
+        << ",\n  \"benchmarks\": [\n";
+    out << setprecision(6);
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", "
+            << "\"ops_per_rep\": " << r.opsPerRep << ", "
+            << "\"reps\": " << r.reps << ", "
+            << "\"median\": " << r.medianNs << ", "
+            << "\"p10\": " << r.p10Ns << ", "
+            << "\"p90\": " << r.p90Ns << ", "
+            << "\"p99\": " << r.p99Ns << ", "
+            << "\"ops_per_sec\": " << r.opsPerSec() << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+// ------------------------- main -------------------------
+int main(int argc, char* argv[]) {
+    SimConfig sim;
+    sim.threads = max(1u, thread::hardware_concurrency());
+    sim.seed = freshSeed();
+    bool printChart = false;
+    bool audit = false;
+    bool generateChart = false;
+    bool rngBench = false;
+    bool bench = false;
+    int benchReps = 31;
+    string benchJson;
+    bool selfTest = false;
+    vector<int> evCards;
+    vector<int> evRemoved;  // cards already gone from the shoe
+    int evDealerUp = 0;
+    long long dealerOdds = 0;
+    string replayPath;
+    string scriptPath;
+    string comparePath;
+    bool antithetic = false;
+    string sweepPath;
+    long long sweepBatch = 100000;
+    double targetCi = 0.0;
+    bool quiet = false;
+    HistoryQuery historyQuery;
+    string serveAddress, loadgenAddress;
+    unsigned serverWorkers = max(1u, thread::hardware_concurrency());
+    int loadgenTables = 100, loadgenRounds = 100;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--simulate" && i + 1 < argc) {
+            sim.rounds = atoll(argv[++i]);
+            if (sim.rounds <= 0) {
+                cerr << "--simulate needs a positive number of rounds\n";
+                return 1;
+            }
+        } else if (arg == "--strategy" && i + 1 < argc) {
+            string error;
+            if (!loadStrategyChart(argv[++i], activeChart, error)) {
+                cerr << error << "\n";
+                return 1;
+            }
+            activeChartLoaded = true;
+        } else if (arg == "--print-chart") {
+            printChart = true;
+        } else if (arg == "--ev" && i + 2 < argc) {
+            istringstream list(argv[++i]);
+            string card;
+            while (getline(list, card, ',')) {
+                evCards.push_back(parseCardValue(card));
+            }
+            evDealerUp = parseCardValue(argv[++i]);
+            if (evCards.empty() || evDealerUp == 0 ||
+                find(evCards.begin(), evCards.end(), 0) != evCards.end()) {
+                cerr << "--ev needs cards like 10,6 and a dealer upcard\n";
+                return 1;
+            }
+        } else if (arg == "--removed" && i + 1 < argc) {
+            istringstream list(argv[++i]);
+            string card;
+            while (getline(list, card, ',')) {
+                evRemoved.push_back(parseCardValue(card));
+            }
+            if (find(evRemoved.begin(), evRemoved.end(), 0) !=
+                evRemoved.end()) {
+                cerr << "--removed needs cards like 10,10,5,A\n";
+                return 1;
+            }
+        } else if (arg == "--audit") {
+            audit = true;
+        } else if (arg == "--generate-chart") {
+            generateChart = true;
+        } else if (arg == "--count" && i + 1 < argc) {
+            sim.count = findCountSystem(argv[++i]);
+            if (!sim.count) {
+                cerr << "--count must be hilo, ko or omega2\n";
+                return 1;
+            }
+        } else if (arg == "--ramp" && i + 1 < argc) {
+            string error;
+            if (!parseBetRamp(argv[++i], sim.ramp, error)) {
+                cerr << "--ramp: " << error << "\n";
+                return 1;
+            }
+        } else if (arg == "--deviations") {
+            sim.deviations = true;
+        } else if (arg == "--bankroll" && i + 1 < argc) {
+            sim.bankrollUnits = atof(argv[++i]);
+            if (sim.bankrollUnits <= 0.0) {
+                cerr << "--bankroll needs a positive number of units\n";
+                return 1;
+            }
+        } else if (arg == "--seats" && i + 1 < argc) {
+            sim.seats = atoi(argv[++i]);
+            if (sim.seats < 1 ||
+                sim.seats > TableEngine<StandardRules>::kMaxSeats) {
+                cerr << "--seats must be 1 to 7\n";
+                return 1;
+            }
+        } else if (arg == "--serve" && i + 1 < argc) {
+            serveAddress = argv[++i];
+        } else if (arg == "--workers" && i + 1 < argc) {
+            serverWorkers = static_cast<unsigned>(max(1, atoi(argv[++i])));
+        } else if (arg == "--loadgen" && i + 1 < argc) {
+            loadgenAddress = argv[++i];
+        } else if (arg == "--tables" && i + 1 < argc) {
+            loadgenTables = max(1, atoi(argv[++i]));
+        } else if (arg == "--rounds" && i + 1 < argc) {
+            loadgenRounds = max(1, atoi(argv[++i]));
+        } else if (arg == "--stats") {
+            sim.detailedStats = true;
+        } else if (arg == "--history" && i + 1 < argc) {
+            sim.historyPath = argv[++i];
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            sim.checkpointPath = argv[++i];
+        } else if (arg == "--checkpoint-every" && i + 1 < argc) {
+            sim.checkpointSeconds = max(0.0, atof(argv[++i]));
+        } else if (arg == "--telemetry" && i + 1 < argc) {
+            sim.telemetrySeconds = atof(argv[++i]);
+        } else if (arg == "--telemetry-json" && i + 1 < argc) {
+            sim.telemetryJson = argv[++i];
+        } else if (arg == "--sweep" && i + 1 < argc) {
+            sweepPath = argv[++i];
+        } else if (arg == "--batch" && i + 1 < argc) {
+            sweepBatch = max(1LL, atoll(argv[++i]));
+        } else if (arg == "--target-ci" && i + 1 < argc) {
+            targetCi = atof(argv[++i]);
+        } else if (arg == "--compare" && i + 1 < argc) {
+            comparePath = argv[++i];
+        } else if (arg == "--antithetic") {
+            antithetic = true;
+        } else if (arg == "--script" && i + 1 < argc) {
+            scriptPath = argv[++i];
+        } else if (arg == "--quiet") {
+            quiet = true;
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (arg == "--query" && i + 1 < argc) {
+            if (!parseHistoryQuery(argv[++i], historyQuery)) {
+                cerr << "--query needs a hand like 16v10, s18v6 or 12vA\n";
+                return 1;
+            }
+        } else if (arg == "--after-split") {
+            historyQuery.splitOnly = true;
+        } else if (arg == "--dealer-odds" && i + 1 < argc) {
+            dealerOdds = atoll(argv[++i]);
+            if (dealerOdds <= 0) {
+                cerr << "--dealer-odds needs a positive number of hands\n";
+                return 1;
+            }
+        } else if (arg == "--h17") {
+            sim.rules.hitSoft17 = true;
+        } else if (arg == "--no-das") {
+            sim.rules.doubleAfterSplit = false;
+        } else if (arg == "--resplit") {
+            sim.rules.resplit = true;
+        } else if (arg == "--surrender") {
+            sim.rules.lateSurrender = true;
+        } else if (arg == "--6to5") {
+            sim.rules.sixToFive = true;
+        } else if (arg == "--rng" && i + 1 < argc) {
+            string name = argv[++i];
+            if (name == "mt19937")      sim.rng = RngKind::Mt19937;
+            else if (name == "xoshiro") sim.rng = RngKind::Xoshiro;
+            else if (name == "pcg")     sim.rng = RngKind::Pcg;
+            else {
+                cerr << "--rng must be mt19937, xoshiro or pcg\n";
+                return 1;
+            }
+        } else if (arg == "--rng-bench") {
+            rngBench = true;
+        } else if (arg == "--bench") {
+            bench = true;
+        } else if (arg == "--bench-reps" && i + 1 < argc) {
+            benchReps = max(1, atoi(argv[++i]));
+        } else if (arg == "--bench-json" && i + 1 < argc) {
+            benchJson = argv[++i];
+        } else if (arg == "--selftest") {
+            selfTest = true;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            sim.threads = static_cast<unsigned>(max(1, atoi(argv[++i])));
+        } else if (arg == "--seed" && i + 1 < argc) {
+            sim.seed = strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--decks" && i + 1 < argc) {
+            sim.rules.decks = atoi(argv[++i]);
+            if (!supportedDeckCount(sim.rules.decks)) {
+                cerr << "--decks must be 1, 2, 4, 6 or 8\n";
+                return 1;
+            }
+        } else if (arg == "--penetration" && i + 1 < argc) {
+            sim.penetration = atof(argv[++i]);
+            if (sim.penetration <= 0.0 || sim.penetration > 1.0) {
+                cerr << "--penetration must be in (0, 1]\n";
+                return 1;
+            }
+        } else if (arg == "--csm" && i + 1 < argc) {
+            sim.csmTray = atoi(argv[++i]);
+            if (sim.csmTray < 0) {
+                cerr << "--csm must be a tray size of 0 or more\n";
+                return 1;
+            }
+        } else {
+            cerr << "Usage: " << argv[0]
+                 << " [--simulate N [--threads T] [--seed S]"
+                    " [--penetration P | --csm TRAY]"
+                    " [--rng mt19937|xoshiro|pcg]]"
+                    " [--count hilo|ko|omega2 [--ramp TC:UNITS,...]"
+                    " [--deviations] [--bankroll UNITS]]"
+                    " [--strategy FILE] [--print-chart]"
+                    " [--ev CARDS UP [--removed CARDS]] [--audit] [--generate-chart]"
+                    " [--seats N] [--dealer-odds N] [--stats]"
+                    " [--compare FILE [--antithetic]]"
+                    " [--sweep FILE [--batch N] [--target-ci PCT]]"
+                    " [--telemetry SECONDS] [--telemetry-json FILE]"
+                    " [--checkpoint FILE [--checkpoint-every SECONDS]]"
+                    " [--history FILE]"
+                    " [--serve ADDR [--workers N]]"
+                    " [--loadgen ADDR|self [--tables N] [--rounds N]]"
+                    " [--replay FILE [--query HAND [--after-split]]]"
+                    " [--script FILE|- [--quiet]]"
+                    " [--decks D] [--h17] [--no-das] [--resplit]"
+                    " [--surrender] [--6to5] [--rng-bench] [--selftest]"
+                    " [--bench [--bench-reps N] [--bench-json FILE]]\n";
+            return 1;
+        }
+    }
+
+    if (sim.seats > 1 && sim.deviations) {
+        // Table seats take plain strategy function pointers
+        cerr << "--deviations is only available with one seat\n";
+        return 1;
+    }
+    int handsPerSeat = sim.rules.resplit ? 4 : 2;
+    if (Shoe::roundCanEmptyShoe(sim.rules.decks, sim.seats * handsPerSeat)) {
+        cerr << sim.seats << " seats" << (sim.rules.resplit ? " with resplits"
+                                                            : "")
+             << " could use up " << sim.rules.decks
+             << " deck(s) in one round; add decks or seat fewer players\n";
+        return 1;
+    }
+    if (!sweepPath.empty() && (sim.rounds <= 0 || sim.seats > 1)) {
+        cerr << "--sweep needs --simulate N (rounds per cell) and one seat\n";
+        return 1;
+    }
+    if (!sim.checkpointPath.empty() && !sim.historyPath.empty()) {
+        // A resumed run could not pick up a half-written history file
+        cerr << "--checkpoint cannot be combined with --history\n";
+        return 1;
+    }
+#ifndef BLACKJACK_TELEMETRY
+    if (sim.telemetrySeconds > 0.0 || !sim.telemetryJson.empty()) {
+        cerr << "telemetry needs a build with -DBLACKJACK_TELEMETRY\n";
+        return 1;
+    }
+#endif
+    if (!comparePath.empty() &&
+        (sim.rounds <= 0 || sim.count || sim.seats > 1)) {
+        cerr << "--compare needs --simulate N, one seat and no --count\n";
+        return 1;
+    }
+
+    if (rngBench) {
+        runRngBenchmark();
+        return 0;
+    }
+    if (selfTest) {
+        return runSelfTest() ? 0 : 1;
+    }
+    if (bench) {
+        vector<BenchResult> results = runBenchmarks(benchReps);
+        printBenchTable(results);
+        if (!benchJson.empty()) {
+            ofstream json(benchJson);
+            if (!json) {
+                cerr << "cannot write " << benchJson << "\n";
+                return 1;
+            }
+            writeBenchJson(json, results);
+        }
+        return 0;
+    }
+
+    // Chart in force for the chosen rules
+    const StrategyChart* chart = &activeChart;
+    if (!activeChartLoaded) {
+        withRuleSet(sim.rules, [&chart](auto rules) {
+            chart = &kRulesChart<decltype(rules)>;
+        });
+    }
+
+    if (printChart) {
+        writeStrategyChart(cout, *chart);
+        return 0;
+    }
+    if (!sweepPath.empty()) {
+        return runSweep(sim, sweepPath, sweepBatch, targetCi) ? 0 : 1;
+    }
+    if (!comparePath.empty()) {
+        // The candidate file only lists the rows it changes
+        StrategyChart candidate = *chart;
+        string error;
+        if (!loadStrategyChart(comparePath, candidate, error)) {
+            cerr << error << "\n";
+            return 1;
+        }
+        runComparison(sim, *chart, candidate, comparePath, antithetic);
+        return 0;
+    }
+
+    EvRules evRules = EvRules::from(sim.rules);
+    if (!evRemoved.empty() && evCards.empty()) {
+        cerr << "--removed only applies to --ev\n";
+        return 1;
+    }
+    if (!evCards.empty()) {
+        // The shoe as the hand sees it: removed cards first, then the
+        // hand and the upcard
+        ShoeComposition comp = ShoeComposition::full(evRules.decks);
+        vector<int> gone = evRemoved;
+        gone.insert(gone.end(), evCards.begin(), evCards.end());
+        gone.push_back(evDealerUp);
+        for (int v : gone) {
+            if (!comp.has(v)) {
+                cerr << "--ev: not that many " << cardValueToString(v)
+                     << "s in " << evRules.decks << " deck(s)\n";
+                return 1;
+            }
+            comp.remove(v);
+        }
+        runEvAnalysis(evRules, comp, evCards, evDealerUp);
+        return 0;
+    }
+    if (audit) {
+        runStrategyAudit(evRules, *chart);
+        return 0;
+    }
+    if (generateChart) {
+        runChartGenerator(sim.rules);
+        return 0;
+    }
+
+    if (!serveAddress.empty() || !loadgenAddress.empty()) {
+        ServerConfig server;
+        server.address = serveAddress.empty() ? loadgenAddress : serveAddress;
+        server.workers = serverWorkers;
+        server.seed = sim.seed;
+        server.decks = sim.rules.decks;
+        server.penetration = sim.penetration;
+        bool ok = serveAddress.empty()
+                      ? runLoadGenerator(server, loadgenTables, loadgenRounds)
+                      : runServer(server);
+        return ok ? 0 : 1;
+    }
+    if (!scriptPath.empty()) {
+        return runScript(scriptPath, sim.seed, quiet) ? 0 : 1;
+    }
+    if (!replayPath.empty()) {
+        return runReplay(replayPath, historyQuery) ? 0 : 1;
+    }
+    if (dealerOdds > 0) {
+        runDealerOdds(sim, dealerOdds);
+        return 0;
+    }
+    if (sim.rounds > 0) {
+        return runSimulation(sim) ? 0 : 1;
+    }
+
+    Deck deck(sim.seed);
+    deck.setCountSystem(sim.count);
+    RoundEngine<StandardRules, ConsoleObserver> engine;
+
+    HandHistoryFile historyFile;
+    unique_ptr<HandHistoryWriter> history;
+    if (!sim.historyPath.empty()) {
+        string error;
+        if (!historyFile.open(sim.historyPath,
+                              makeHistoryHeader(RuleOptions{}, sim.seed),
+                              error)) {
+            cerr << error << "\n";
+            return 1;
+        }
+        history = make_unique<HandHistoryWriter>(historyFile, sim.seed, 0);
+    }
+
+    // The whole game is one bankroll session, binned by single bets
+    StreamingStats session;
+    session.trajectory.sessionRounds = numeric_limits<long long>::max();
+    session.trajectory.binWidth = 1.0;
+
+    double bankroll = 100.0;
+    char playAgain = 'Y';
+    showWelcome();
+
+    while (playAgain == 'Y' && bankroll > 0.0) {
+        cout << "\n===== NEW ROUND =====\n";
+        if (sim.count) {
+            deck.prepareRound();
+            int tc = trueCountBucket(deck.trueCount());
+            cout << "Shoe: " << deck.cardsRemaining() << " cards left, "
+                 << sim.count->name << " running count "
+                 << deck.runningCount() << ", true count " << tc
+                 << " (ramp: " << sim.ramp.betFor(tc) << " units)\n";
+        }
+        double baseBet = getBet(bankroll);
+
+        RoundOutcome outcome =
+            engine.play(deck, baseBet, bankroll, consoleDecision);
+        bankroll += outcome.net;
+        if (history) history->record(engine.roundState(), outcome, baseBet);
+        session.record(engine.roundState(), outcome, baseBet);
+
+        cout << "Your bankroll: $" << bankroll << "\n";
+        if (bankroll <= 0.0) {
+            cout << "You are out of money. Game over.\n";
+            break;
+        }
+
+        cout << "Play another round? (Y/N): ";
+        cin >> playAgain;
+        playAgain =
+            static_cast<char>(toupper(static_cast<unsigned char>(playAgain)));
+    }
+
+    if (history) {
+        history.reset();
+        if (!historyFile.close()) {
+            cerr << "error writing " << sim.historyPath << "\n";
+            return 1;
+        }
+    }
+    if (session.rounds > 0) {
+        cout << "\n===== SESSION SUMMARY =====\n";
+        cout << "Rounds played:   " << session.rounds << "\n";
+        printStreamingStats(cout, session, false);
+    }
+    cout << "Thanks for playing Casino Blackjack!\n";
+    return 0;
+}